@@ -0,0 +1,122 @@
+//
+//  decode_base64_bench.cpp
+//
+//  Microbenchmark of extend_helpers::decode_base64 against the previous
+//  table-per-character implementation, on blobs of typical tx sizes.
+//
+//  Build and run from the repository root, e.g.
+//      c++ -O2 -std=c++11 -Isrc bench/decode_base64_bench.cpp src/extend_helpers.cpp -o decode_base64_bench
+//      ./decode_base64_bench
+//
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+//
+#include "extend_helpers.hpp"
+
+using namespace std;
+
+namespace {
+	// extend_helpers::decode_base64 as it was before the vector kernels
+	void decode_base64_legacy(const string &input, string &out) {
+		size_t in_len = input.size();
+		if (in_len % 4 != 0 && in_len != 0) {
+			throw std::invalid_argument("Input length must be divisible by 4");
+		}
+
+		out.clear();
+		if (in_len == 0) {
+			return;
+		}
+
+		size_t out_len = in_len / 4 * 3;
+		if (input[in_len - 1] == '=') out_len--;
+		if (input[in_len - 2] == '=') out_len--;
+
+		out.reserve(out_len);
+
+		for (size_t i = 0; i < in_len;) {
+			uint32_t a = input[i] == '=' ? 0 : extend_helpers::DECODE_TABLE[static_cast<unsigned char>(input[i])]; i++;
+			uint32_t b = input[i] == '=' ? 0 : extend_helpers::DECODE_TABLE[static_cast<unsigned char>(input[i])]; i++;
+			uint32_t c = input[i] == '=' ? 0 : extend_helpers::DECODE_TABLE[static_cast<unsigned char>(input[i])]; i++;
+			uint32_t d = input[i] == '=' ? 0 : extend_helpers::DECODE_TABLE[static_cast<unsigned char>(input[i])]; i++;
+
+			uint32_t triple = (a << 18) + (b << 12) + (c << 6) + d;
+
+			if (out.size() < out_len) out.push_back((triple >> 16) & 0xFF);
+			if (out.size() < out_len) out.push_back((triple >> 8) & 0xFF);
+			if (out.size() < out_len) out.push_back(triple & 0xFF);
+		}
+	}
+
+	string encode_base64(const string &in) {
+		static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		string out;
+		size_t i = 0;
+		for (; i + 3 <= in.size(); i += 3) {
+			uint32_t triple = (uint8_t(in[i]) << 16) | (uint8_t(in[i + 1]) << 8) | uint8_t(in[i + 2]);
+			out += alphabet[(triple >> 18) & 63];
+			out += alphabet[(triple >> 12) & 63];
+			out += alphabet[(triple >> 6) & 63];
+			out += alphabet[triple & 63];
+		}
+		if (i < in.size()) {
+			uint32_t triple = uint8_t(in[i]) << 16;
+			if (i + 1 < in.size()) triple |= uint8_t(in[i + 1]) << 8;
+			out += alphabet[(triple >> 18) & 63];
+			out += alphabet[(triple >> 12) & 63];
+			out += i + 1 < in.size() ? alphabet[(triple >> 6) & 63] : '=';
+			out += '=';
+		}
+		return out;
+	}
+
+	template<typename F>
+	double mb_per_s(const vector<string> &inputs, size_t total, F decode) {
+		string out;
+		size_t checksum = 0;
+		const int rounds = 200;
+		auto start = chrono::steady_clock::now();
+		for (int r = 0; r < rounds; r++) {
+			for (const auto &input : inputs) {
+				decode(input, out);
+				checksum += out.size();
+			}
+		}
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (checksum != total * rounds) {
+			fprintf(stderr, "unexpected output size\n");
+			exit(1);
+		}
+		return double(total) * rounds / seconds / 1e6;
+	}
+}
+
+int main() {
+	srand(1);
+	const size_t sizes[] = { 1500, 2600, 14000, 40000 }; // 1in/2out, 2in/2out, 16in and large txs
+	for (size_t size : sizes) {
+		vector<string> inputs;
+		size_t total = 0;
+		for (int i = 0; i < 64; i++) {
+			string blob(size + i, '\0');
+			for (auto &c : blob) c = char(rand());
+			inputs.push_back(encode_base64(blob));
+			total += blob.size();
+
+			string decoded;
+			extend_helpers::decode_base64(inputs.back(), decoded);
+			if (decoded != blob) {
+				fprintf(stderr, "mismatch at size %zu\n", blob.size());
+				return 1;
+			}
+		}
+
+		double legacy = mb_per_s(inputs, total, decode_base64_legacy);
+		double current = mb_per_s(inputs, total, [](const string &in, string &out) { extend_helpers::decode_base64(in, out); });
+		printf("%6zu bytes: legacy %8.1f MB/s, current %8.1f MB/s (x%.1f)\n", size, legacy, current, current / legacy);
+	}
+	return 0;
+}
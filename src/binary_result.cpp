@@ -0,0 +1,329 @@
+//
+//  binary_result.cpp
+//
+#include "binary_result.hpp"
+//
+#include <cstring>
+//
+#include "common/int-util.h"
+
+using namespace std;
+//
+using namespace binary_result;
+using namespace serial_bridge;
+
+namespace {
+	const char MAGIC[4] = { 'M', 'M', 'S', 'R' };
+
+	class Encoder
+	{
+	public:
+		explicit Encoder(std::string &out) : m_out(out) {}
+
+		void u8(uint8_t v) { m_out += static_cast<char>(v); }
+		void u32(uint32_t v) { v = SWAP32LE(v); m_out.append(reinterpret_cast<const char *>(&v), sizeof(v)); }
+		void u64(uint64_t v) { v = SWAP64LE(v); m_out.append(reinterpret_cast<const char *>(&v), sizeof(v)); }
+		void bytes(const void *data, size_t size) { m_out.append(static_cast<const char *>(data), size); }
+		template<typename T>
+		void pod(const T &v) { bytes(&v, sizeof(v)); }
+		void str(const std::string &v) { u32(v.size()); bytes(v.data(), v.size()); }
+
+		void header(Kind kind)
+		{
+			bytes(MAGIC, sizeof(MAGIC));
+			u8(VERSION);
+			u8(kind);
+			u8(0);
+			u8(0);
+		}
+
+	private:
+		std::string &m_out;
+	};
+
+	class Decoder
+	{
+	public:
+		Decoder(const char *buffer, size_t length) : m_p(buffer), m_end(buffer + length) {}
+
+		bool bytes(void *out, size_t size)
+		{
+			if (static_cast<size_t>(m_end - m_p) < size) {
+				return false;
+			}
+			memcpy(out, m_p, size);
+			m_p += size;
+			return true;
+		}
+		bool u8(uint8_t &v) { return bytes(&v, sizeof(v)); }
+		bool u32(uint32_t &v) { if (!bytes(&v, sizeof(v))) return false; v = SWAP32LE(v); return true; }
+		bool u64(uint64_t &v) { if (!bytes(&v, sizeof(v))) return false; v = SWAP64LE(v); return true; }
+		template<typename T>
+		bool pod(T &v) { return bytes(&v, sizeof(v)); }
+		bool str(std::string &v)
+		{
+			uint32_t size;
+			if (!u32(size) || static_cast<size_t>(m_end - m_p) < size) {
+				return false;
+			}
+			v.assign(m_p, size);
+			m_p += size;
+			return true;
+		}
+		// Counts are checked against what is left, so a corrupt one cannot make the caller reserve gigabytes
+		bool count(uint32_t &v, size_t min_item_size)
+		{
+			return u32(v) && v <= static_cast<size_t>(m_end - m_p) / min_item_size;
+		}
+
+		bool header(Kind kind)
+		{
+			char magic[sizeof(MAGIC)];
+			uint8_t version, actual_kind, reserved;
+			return bytes(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0
+				&& u8(version) && version == VERSION
+				&& u8(actual_kind) && actual_kind == kind
+				&& u8(reserved) && u8(reserved);
+		}
+		bool at_end() const { return m_p == m_end; }
+
+	private:
+		const char *m_p;
+		const char *m_end;
+	};
+
+	const size_t MIN_UTXO_SIZE = 1 + 8 + 1 + 4 + 4 + 32 + 32 + 32;
+
+	void encode_utxo(Encoder &e, const Utxo &utxo, bool native)
+	{
+		e.u8(utxo.vout);
+		e.u64(utxo.amount);
+
+		if (utxo.key_image) {
+			e.u8(1);
+			e.pod(*utxo.key_image);
+		} else {
+			e.u8(0);
+		}
+
+		e.u32(utxo.index.major);
+		e.u32(utxo.index.minor);
+		e.pod(utxo.derivation);
+		e.pod(utxo.mask);
+
+		if (native) {
+			e.pod(utxo.pub);
+			e.u64(utxo.global_index);
+			e.u8(utxo.rv.size);
+			e.bytes(utxo.rv.data, utxo.rv.size);
+		} else {
+			e.pod(utxo.tx_id);
+		}
+	}
+
+	bool decode_utxo(Decoder &d, Utxo &utxo, bool native)
+	{
+		uint8_t has_key_image;
+		if (!d.u8(utxo.vout) || !d.u64(utxo.amount) || !d.u8(has_key_image)) {
+			return false;
+		}
+
+		utxo.key_image = boost::none;
+		if (has_key_image) {
+			crypto::key_image key_image;
+			if (!d.pod(key_image)) {
+				return false;
+			}
+			utxo.key_image = key_image;
+		}
+
+		if (!d.u32(utxo.index.major) || !d.u32(utxo.index.minor) || !d.pod(utxo.derivation) || !d.pod(utxo.mask)) {
+			return false;
+		}
+
+		if (native) {
+			if (!d.pod(utxo.pub) || !d.u64(utxo.global_index) || !d.u8(utxo.rv.size) || utxo.rv.size > sizeof(utxo.rv.data) || !d.bytes(utxo.rv.data, utxo.rv.size)) {
+				return false;
+			}
+		} else {
+			if (!d.pod(utxo.tx_id)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void encode_tx(Encoder &e, const WalletAccountTransaction &account_tx)
+	{
+		const BridgeTransaction &tx = *account_tx.tx;
+
+		e.pod(tx.id);
+		e.u64(tx.timestamp);
+		e.u64(tx.block_height);
+		e.pod(tx.pub);
+		e.u64(tx.fee_amount);
+
+		// Same precedence as the JSON: an encrypted payment id hides a long one
+		if (tx.payment_id8 != crypto::null_hash8) {
+			e.u8(sizeof(tx.payment_id8));
+			e.pod(tx.payment_id8);
+		} else if (tx.payment_id != crypto::null_hash) {
+			e.u8(sizeof(tx.payment_id));
+			e.pod(tx.payment_id);
+		} else {
+			e.u8(0);
+		}
+
+		e.u32(tx.additional_pubs.size());
+		for (const auto &pub : tx.additional_pubs) {
+			e.pod(pub);
+		}
+		e.u32(account_tx.inputs.size());
+		for (const auto &input : account_tx.inputs) {
+			e.pod(input);
+		}
+		e.u32(account_tx.utxos.size());
+		for (const auto &utxo : account_tx.utxos) {
+			encode_utxo(e, utxo, true);
+		}
+	}
+
+	bool decode_tx(Decoder &d, WalletAccountTransaction &account_tx)
+	{
+		auto tx = std::make_shared<BridgeTransaction>();
+
+		uint8_t payment_id_size;
+		if (!d.pod(tx->id) || !d.u64(tx->timestamp) || !d.u64(tx->block_height) || !d.pod(tx->pub) || !d.u64(tx->fee_amount) || !d.u8(payment_id_size)) {
+			return false;
+		}
+
+		if (payment_id_size == sizeof(tx->payment_id8)) {
+			if (!d.pod(tx->payment_id8)) return false;
+		} else if (payment_id_size == sizeof(tx->payment_id)) {
+			if (!d.pod(tx->payment_id)) return false;
+		} else if (payment_id_size != 0) {
+			return false;
+		}
+
+		uint32_t count;
+		if (!d.count(count, 32)) {
+			return false;
+		}
+		tx->additional_pubs.resize(count);
+		for (auto &pub : tx->additional_pubs) {
+			if (!d.pod(pub)) return false;
+		}
+		if (!d.count(count, 32)) {
+			return false;
+		}
+		account_tx.inputs.resize(count);
+		for (auto &input : account_tx.inputs) {
+			if (!d.pod(input)) return false;
+		}
+		if (!d.count(count, MIN_UTXO_SIZE)) {
+			return false;
+		}
+		account_tx.utxos.resize(count);
+		for (auto &utxo : account_tx.utxos) {
+			if (!decode_utxo(d, utxo, true)) {
+				return false;
+			}
+			utxo.tx_id = tx->id;
+			utxo.tx_pub = tx->pub;
+			utxo.block_height = tx->block_height;
+		}
+
+		account_tx.tx = std::move(tx);
+		return true;
+	}
+}
+//
+bool binary_result::encode(const NativeResponse &resp, std::string &out)
+{
+	Encoder e(out);
+	e.header(KindNativeResponse);
+	e.u64(resp.current_height);
+	e.u64(resp.end_height);
+	e.u64(resp.latest);
+	e.u64(resp.oldest);
+	e.u64(resp.size);
+
+	e.u32(resp.results_by_wallet_account.size());
+	for (const auto &pair : resp.results_by_wallet_account) {
+		e.str(pair.first);
+		e.u32(pair.second.subaddresses);
+		e.u32(pair.second.txs.size());
+		for (const auto &account_tx : pair.second.txs) {
+			encode_tx(e, account_tx);
+		}
+	}
+	return true;
+}
+bool binary_result::encode(const ExtractUtxosResponse &resp, std::string &out)
+{
+	Encoder e(out);
+	e.header(KindExtractUtxosResponse);
+
+	e.u32(resp.results_by_wallet_account.size());
+	for (const auto &pair : resp.results_by_wallet_account) {
+		e.str(pair.first);
+		e.u32(pair.second.subaddresses);
+		e.u32(pair.second.utxos.size());
+		for (const auto &utxo : pair.second.utxos) {
+			encode_utxo(e, utxo, false);
+		}
+	}
+	return true;
+}
+bool binary_result::decode(const char *buffer, size_t length, NativeResponse &resp)
+{
+	Decoder d(buffer, length);
+	uint32_t accounts_count;
+	if (!d.header(KindNativeResponse)
+		|| !d.u64(resp.current_height) || !d.u64(resp.end_height) || !d.u64(resp.latest) || !d.u64(resp.oldest) || !d.u64(resp.size)
+		|| !d.count(accounts_count, 4 + 4 + 4)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < accounts_count; i++) {
+		std::string id;
+		ExtractTransactionsResult result;
+		uint32_t txs_count;
+		if (!d.str(id) || !d.u32(result.subaddresses) || !d.count(txs_count, 32 + 8 + 8 + 32 + 8 + 1 + 4 + 4 + 4)) {
+			return false;
+		}
+		result.txs.resize(txs_count);
+		for (auto &account_tx : result.txs) {
+			if (!decode_tx(d, account_tx)) {
+				return false;
+			}
+		}
+		resp.results_by_wallet_account[id] = std::move(result);
+	}
+	return d.at_end();
+}
+bool binary_result::decode(const char *buffer, size_t length, ExtractUtxosResponse &resp)
+{
+	Decoder d(buffer, length);
+	uint32_t accounts_count;
+	if (!d.header(KindExtractUtxosResponse) || !d.count(accounts_count, 4 + 4 + 4)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < accounts_count; i++) {
+		std::string id;
+		ExtractUtxosResult result;
+		uint32_t utxos_count;
+		if (!d.str(id) || !d.u32(result.subaddresses) || !d.count(utxos_count, MIN_UTXO_SIZE)) {
+			return false;
+		}
+		result.utxos.resize(utxos_count);
+		for (auto &utxo : result.utxos) {
+			if (!decode_utxo(d, utxo, false)) {
+				return false;
+			}
+		}
+		resp.results_by_wallet_account[id] = std::move(result);
+	}
+	return d.at_end();
+}
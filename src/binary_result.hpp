@@ -0,0 +1,59 @@
+//
+//  binary_result.hpp
+//
+//  Compact binary encoding of scan results, as an alternative to the JSON
+//  returned by the bridge functions. Keys, hashes and masks are raw 32 bytes
+//  instead of 64 hex characters and amounts are integers instead of decimal
+//  strings.
+//
+//  All integers little endian. A result is a header followed by the body:
+//    header   4 byte magic "MMSR", u8 version, u8 kind, 2 reserved
+//    string   u32 length + bytes
+//    list     u32 count + items
+//  NativeResponse body (kind 1):
+//    u64 current_height, end_height, latest, oldest, size
+//    list of accounts: string id, u32 subaddresses, list of txs:
+//      32 id, u64 timestamp, u64 height, 32 pub, u64 fee,
+//      u8 payment id size (0, 8 or 32) + payment id (8: epid, 32: pid),
+//      list of 32 additional pubs, list of 32 inputs, list of utxos
+//  ExtractUtxosResponse body (kind 2):
+//    list of accounts: string id, u32 subaddresses, list of utxos
+//  utxo:
+//    u8 vout, u64 amount, u8 has key image (+ 32 key image if 1), u32 major, u32 minor,
+//    32 derivation, 32 mask, then
+//      in NativeResponse: 32 pub, u64 global_index, u8 rv size + rv
+//      in ExtractUtxosResponse: 32 tx id
+//
+//  Errors are not encoded; the bridge returns them as the usual JSON error
+//  object, which starts with '{' rather than the magic.
+//
+
+#ifndef binary_result_hpp
+#define binary_result_hpp
+
+#include <string>
+//
+#include "serial_bridge_index.hpp"
+
+namespace binary_result
+{
+	using namespace std;
+
+	const uint8_t VERSION = 1;
+
+	enum Kind : uint8_t
+	{
+		KindNativeResponse = 1,
+		KindExtractUtxosResponse = 2
+	};
+
+	// Returns false if the response cannot be represented; with every field held in binary it presently always can
+	bool encode(const serial_bridge::NativeResponse &resp, std::string &out);
+	bool encode(const serial_bridge::ExtractUtxosResponse &resp, std::string &out);
+
+	// Returns false on anything malformed or truncated
+	bool decode(const char *buffer, size_t length, serial_bridge::NativeResponse &resp);
+	bool decode(const char *buffer, size_t length, serial_bridge::ExtractUtxosResponse &resp);
+}
+
+#endif /* binary_result_hpp */
@@ -0,0 +1,421 @@
+//
+//  blocks_bin_reader.cpp
+//
+#include "blocks_bin_reader.hpp"
+//
+#include <cstring>
+//
+#include "common/int-util.h"
+#include "storages/portable_storage_base.h"
+
+using namespace std;
+//
+using namespace blocks_bin_reader;
+
+namespace {
+	const size_t recursion_limit = 100; // same as epee's EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL
+
+	struct Cursor
+	{
+		const char *pos;
+		const char *end;
+
+		size_t left() const { return end - pos; }
+
+		bool read(void *out, size_t n)
+		{
+			if (left() < n) return false;
+			memcpy(out, pos, n);
+			pos += n;
+			return true;
+		}
+		bool skip(size_t n)
+		{
+			if (left() < n) return false;
+			pos += n;
+			return true;
+		}
+		bool read_varint(size_t &v)
+		{ // epee varint: the two low bits of the first byte give the width
+			if (pos == end) return false;
+			uint64_t raw = 0;
+			switch (static_cast<uint8_t>(*pos) & PORTABLE_RAW_SIZE_MARK_MASK) {
+				case PORTABLE_RAW_SIZE_MARK_BYTE: {
+					uint8_t b;
+					if (!read(&b, sizeof(b))) return false;
+					raw = b;
+					break;
+				}
+				case PORTABLE_RAW_SIZE_MARK_WORD: {
+					uint16_t w;
+					if (!read(&w, sizeof(w))) return false;
+					raw = SWAP16LE(w);
+					break;
+				}
+				case PORTABLE_RAW_SIZE_MARK_DWORD: {
+					uint32_t d;
+					if (!read(&d, sizeof(d))) return false;
+					raw = SWAP32LE(d);
+					break;
+				}
+				default: {
+					uint64_t q;
+					if (!read(&q, sizeof(q))) return false;
+					raw = SWAP64LE(q);
+					break;
+				}
+			}
+			v = raw >> 2;
+			return true;
+		}
+		bool read_string(cryptonote::blobdata_ref &s)
+		{
+			size_t len;
+			if (!read_varint(len) || left() < len) return false;
+			s = cryptonote::blobdata_ref(pos, len);
+			pos += len;
+			return true;
+		}
+		bool read_name(cryptonote::blobdata_ref &name)
+		{
+			uint8_t len;
+			if (!read(&len, sizeof(len)) || left() < len) return false;
+			name = cryptonote::blobdata_ref(pos, len);
+			pos += len;
+			return true;
+		}
+	};
+
+	size_t pod_size(uint8_t type)
+	{
+		switch (type) {
+			case SERIALIZE_TYPE_INT64:
+			case SERIALIZE_TYPE_UINT64:
+			case SERIALIZE_TYPE_DOUBLE:
+				return 8;
+			case SERIALIZE_TYPE_INT32:
+			case SERIALIZE_TYPE_UINT32:
+				return 4;
+			case SERIALIZE_TYPE_INT16:
+			case SERIALIZE_TYPE_UINT16:
+				return 2;
+			case SERIALIZE_TYPE_INT8:
+			case SERIALIZE_TYPE_UINT8:
+			case SERIALIZE_TYPE_BOOL:
+				return 1;
+			default:
+				return 0;
+		}
+	}
+
+	bool skip_value(Cursor &c, uint8_t type, size_t depth);
+
+	bool skip_array(Cursor &c, uint8_t type, size_t depth)
+	{
+		size_t count;
+		if (!c.read_varint(count)) return false;
+
+		const size_t size = pod_size(type);
+		if (size != 0) {
+			return count <= c.left() / size && c.skip(count * size);
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			if (!skip_value(c, type, depth)) return false;
+		}
+		return true;
+	}
+
+	bool skip_section(Cursor &c, size_t depth)
+	{
+		size_t count;
+		if (!c.read_varint(count)) return false;
+
+		for (size_t i = 0; i < count; i++) {
+			cryptonote::blobdata_ref name;
+			uint8_t type;
+			if (!c.read_name(name) || !c.read(&type, sizeof(type))) return false;
+			if (!skip_value(c, type, depth)) return false;
+		}
+		return true;
+	}
+
+	bool skip_value(Cursor &c, uint8_t type, size_t depth)
+	{
+		if (depth > recursion_limit) return false;
+
+		if (type & SERIALIZE_FLAG_ARRAY) {
+			return skip_array(c, type & ~SERIALIZE_FLAG_ARRAY, depth + 1);
+		}
+
+		switch (type) {
+			case SERIALIZE_TYPE_STRING: {
+				cryptonote::blobdata_ref s;
+				return c.read_string(s);
+			}
+			case SERIALIZE_TYPE_OBJECT:
+				return skip_section(c, depth + 1);
+			case SERIALIZE_TYPE_ARRAY: { // array of arrays; every element carries its own type
+				uint8_t element_type;
+				if (!c.read(&element_type, sizeof(element_type)) || !(element_type & SERIALIZE_FLAG_ARRAY)) return false;
+				return skip_array(c, element_type & ~SERIALIZE_FLAG_ARRAY, depth + 1);
+			}
+			default: {
+				const size_t size = pod_size(type);
+				return size != 0 && c.skip(size);
+			}
+		}
+	}
+
+	bool read_unsigned(Cursor &c, uint8_t type, uint64_t &v)
+	{
+		switch (pod_size(type)) {
+			case 8: {
+				uint64_t q;
+				if (!c.read(&q, sizeof(q))) return false;
+				v = SWAP64LE(q);
+				return true;
+			}
+			case 4: {
+				uint32_t d;
+				if (!c.read(&d, sizeof(d))) return false;
+				v = SWAP32LE(d);
+				return true;
+			}
+			case 2: {
+				uint16_t w;
+				if (!c.read(&w, sizeof(w))) return false;
+				v = SWAP16LE(w);
+				return true;
+			}
+			case 1: {
+				uint8_t b;
+				if (!c.read(&b, sizeof(b))) return false;
+				v = b;
+				return true;
+			}
+			default:
+				return false;
+		}
+	}
+
+	bool read_tx_blob(Cursor &c, cryptonote::blobdata_ref &blob)
+	{ // tx_blob_entry { blob, prunable_hash }
+		size_t count;
+		if (!c.read_varint(count)) return false;
+
+		bool has_blob = false;
+		for (size_t i = 0; i < count; i++) {
+			cryptonote::blobdata_ref name;
+			uint8_t type;
+			if (!c.read_name(name) || !c.read(&type, sizeof(type))) return false;
+
+			if (name == "blob" && type == SERIALIZE_TYPE_STRING) {
+				if (!c.read_string(blob)) return false;
+				has_blob = true;
+			} else if (!skip_value(c, type, 1)) {
+				return false;
+			}
+		}
+		return has_blob;
+	}
+
+	bool read_block(Cursor &c, BlockView &block)
+	{ // block_complete_entry { pruned, block, block_weight, txs }
+		size_t count;
+		if (!c.read_varint(count)) return false;
+
+		bool has_block = false;
+		block.txs.clear();
+		for (size_t i = 0; i < count; i++) {
+			cryptonote::blobdata_ref name;
+			uint8_t type;
+			if (!c.read_name(name) || !c.read(&type, sizeof(type))) return false;
+
+			if (name == "block" && type == SERIALIZE_TYPE_STRING) {
+				if (!c.read_string(block.block)) return false;
+				has_block = true;
+			} else if (name == "txs" && type == (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY)) { // pruned
+				size_t txs_count;
+				if (!c.read_varint(txs_count)) return false;
+				for (size_t j = 0; j < txs_count; j++) {
+					cryptonote::blobdata_ref blob;
+					if (!read_tx_blob(c, blob)) return false;
+					block.txs.push_back(blob);
+				}
+			} else if (name == "txs" && type == (SERIALIZE_TYPE_STRING | SERIALIZE_FLAG_ARRAY)) { // not pruned
+				size_t txs_count;
+				if (!c.read_varint(txs_count)) return false;
+				for (size_t j = 0; j < txs_count; j++) {
+					cryptonote::blobdata_ref blob;
+					if (!c.read_string(blob)) return false;
+					block.txs.push_back(blob);
+				}
+			} else if (!skip_value(c, type, 1)) {
+				return false;
+			}
+		}
+		return has_block;
+	}
+
+	bool read_tx_output_indices(Cursor &c, std::vector<uint64_t> &indices)
+	{ // tx_output_indices { indices }
+		size_t count;
+		if (!c.read_varint(count)) return false;
+
+		indices.clear(); // epee leaves out empty containers altogether
+		for (size_t i = 0; i < count; i++) {
+			cryptonote::blobdata_ref name;
+			uint8_t type;
+			if (!c.read_name(name) || !c.read(&type, sizeof(type))) return false;
+
+			size_t indices_count;
+			if (name == "indices" && type == (SERIALIZE_TYPE_UINT64 | SERIALIZE_FLAG_ARRAY)) {
+				if (!c.read_varint(indices_count)) return false;
+			} else if (name == "indices" && type == SERIALIZE_TYPE_STRING) { // container serialized as a blob
+				if (!c.read_varint(indices_count) || indices_count % sizeof(uint64_t) != 0) return false;
+				indices_count /= sizeof(uint64_t);
+			} else {
+				if (!skip_value(c, type, 1)) return false;
+				continue;
+			}
+
+			if (indices_count > c.left() / sizeof(uint64_t)) return false;
+			indices.resize(indices_count);
+			for (size_t k = 0; k < indices_count; k++) {
+				uint64_t index;
+				memcpy(&index, c.pos + k * sizeof(uint64_t), sizeof(uint64_t));
+				indices[k] = SWAP64LE(index);
+			}
+			c.pos += indices_count * sizeof(uint64_t);
+		}
+		return true;
+	}
+
+	bool read_block_output_indices(Cursor &c, std::vector<std::vector<uint64_t>> &output_indices)
+	{ // block_output_indices { indices }
+		size_t count;
+		if (!c.read_varint(count)) return false;
+
+		size_t txs_count = 0;
+		for (size_t i = 0; i < count; i++) {
+			cryptonote::blobdata_ref name;
+			uint8_t type;
+			if (!c.read_name(name) || !c.read(&type, sizeof(type))) return false;
+
+			if (name == "indices" && type == (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY)) {
+				if (!c.read_varint(txs_count) || txs_count > c.left()) return false;
+				if (output_indices.size() < txs_count) { // keep the inner vectors' capacity around between blocks
+					output_indices.resize(txs_count);
+				}
+				for (size_t j = 0; j < txs_count; j++) {
+					if (!read_tx_output_indices(c, output_indices[j])) return false;
+				}
+			} else if (!skip_value(c, type, 1)) {
+				return false;
+			}
+		}
+		output_indices.resize(txs_count);
+		return true;
+	}
+
+	bool read_array_start(Cursor &c, size_t &count, size_t &offset, const char *buffer)
+	{
+		if (!c.read_varint(count)) return false;
+		offset = c.pos - buffer;
+		return true;
+	}
+}
+
+Reader::Reader(const char *buffer, size_t length)
+	: m_buffer(buffer)
+	, m_length(length)
+{
+}
+
+bool Reader::init()
+{
+	Cursor c{m_buffer, m_buffer + m_length};
+
+	uint32_t signature_a, signature_b;
+	uint8_t version;
+	if (!c.read(&signature_a, sizeof(signature_a)) || !c.read(&signature_b, sizeof(signature_b)) || !c.read(&version, sizeof(version))) {
+		return false;
+	}
+	if (SWAP32LE(signature_a) != PORTABLE_STORAGE_SIGNATUREA || SWAP32LE(signature_b) != PORTABLE_STORAGE_SIGNATUREB || version != PORTABLE_STORAGE_FORMAT_VER) {
+		return false;
+	}
+
+	size_t count;
+	if (!c.read_varint(count)) return false;
+
+	size_t output_indices_count = 0;
+	for (size_t i = 0; i < count; i++) {
+		cryptonote::blobdata_ref name;
+		uint8_t type;
+		if (!c.read_name(name) || !c.read(&type, sizeof(type))) return false;
+
+		if (name == "blocks" && type == (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY)) {
+			if (!read_array_start(c, m_blocks_count, m_blocks_offset, m_buffer)) return false;
+			for (size_t j = 0; j < m_blocks_count; j++) {
+				if (!skip_section(c, 1)) return false;
+			}
+		} else if (name == "output_indices" && type == (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY)) {
+			if (!read_array_start(c, output_indices_count, m_output_indices_offset, m_buffer)) return false;
+			for (size_t j = 0; j < output_indices_count; j++) {
+				if (!skip_section(c, 1)) return false;
+			}
+		} else if (name == "current_height" && pod_size(type) != 0) {
+			if (!read_unsigned(c, type, m_current_height)) return false;
+		} else if (!skip_value(c, type, 0)) {
+			return false;
+		}
+	}
+
+	if (m_blocks_count != output_indices_count) {
+		return false;
+	}
+
+	// Dry run over every block so that next() cannot fail half way through a scan
+	BlockView scratch;
+	const size_t blocks_offset = m_blocks_offset;
+	const size_t output_indices_offset = m_output_indices_offset;
+	m_blocks_left = m_blocks_count;
+	while (m_blocks_left != 0) {
+		Cursor blocks_cursor{m_buffer + m_blocks_offset, m_buffer + m_length};
+		Cursor output_indices_cursor{m_buffer + m_output_indices_offset, m_buffer + m_length};
+		if (!read_block(blocks_cursor, scratch) || !read_block_output_indices(output_indices_cursor, scratch.output_indices)) {
+			return false;
+		}
+		if (scratch.output_indices.size() < scratch.txs.size() + 1) {
+			return false;
+		}
+		m_blocks_offset = blocks_cursor.pos - m_buffer;
+		m_output_indices_offset = output_indices_cursor.pos - m_buffer;
+		m_blocks_left--;
+	}
+	m_blocks_offset = blocks_offset;
+	m_output_indices_offset = output_indices_offset;
+	m_blocks_left = m_blocks_count;
+
+	return true;
+}
+
+bool Reader::next(BlockView &block)
+{
+	if (m_blocks_left == 0) {
+		return false;
+	}
+
+	Cursor blocks_cursor{m_buffer + m_blocks_offset, m_buffer + m_length};
+	Cursor output_indices_cursor{m_buffer + m_output_indices_offset, m_buffer + m_length};
+	if (!read_block(blocks_cursor, block) || !read_block_output_indices(output_indices_cursor, block.output_indices)) {
+		m_blocks_left = 0; // init() has already validated the layout
+		return false;
+	}
+	m_blocks_offset = blocks_cursor.pos - m_buffer;
+	m_output_indices_offset = output_indices_cursor.pos - m_buffer;
+	m_blocks_left--;
+
+	return true;
+}
@@ -0,0 +1,56 @@
+//
+//  blocks_bin_reader.hpp
+//
+//  Streaming decoder for the epee portable storage layout of
+//  COMMAND_RPC_GET_BLOCKS_FAST::response (getblocks.bin). Blocks are handed out
+//  one at a time as views into the caller's buffer instead of materialising the
+//  whole response.
+//
+
+#ifndef blocks_bin_reader_hpp
+#define blocks_bin_reader_hpp
+
+#include <string>
+#include <vector>
+#include "cryptonote_basic/blobdatatype.h"
+
+namespace blocks_bin_reader
+{
+	using namespace std;
+
+	struct BlockView
+	{
+		cryptonote::blobdata_ref block;
+		std::vector<cryptonote::blobdata_ref> txs; // pruned or full tx blobs, without the miner tx
+		std::vector<std::vector<uint64_t>> output_indices; // [0] is the miner tx, [j + 1] is txs[j]
+	};
+
+	class Reader
+	{
+	public:
+		// The buffer must outlive the reader and every view it hands out
+		Reader(const char *buffer, size_t length);
+
+		// Validates the whole response up front, so a malformed one is rejected before any block is handed out
+		bool init();
+
+		uint64_t current_height() const { return m_current_height; }
+		size_t blocks_count() const { return m_blocks_count; }
+
+		// Reuses the vectors of the passed view; returns false once all blocks have been read
+		bool next(BlockView &block);
+
+	private:
+		const char *m_buffer;
+		size_t m_length;
+
+		uint64_t m_current_height = 0;
+		size_t m_blocks_count = 0;
+
+		size_t m_blocks_offset = 0; // next element of 'blocks'
+		size_t m_output_indices_offset = 0; // next element of 'output_indices'
+		size_t m_blocks_left = 0;
+	};
+}
+
+#endif /* blocks_bin_reader_hpp */
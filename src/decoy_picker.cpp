@@ -0,0 +1,236 @@
+//
+//  decoy_picker.cpp
+//
+#include "decoy_picker.hpp"
+//
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <random>
+#include <unordered_set>
+//
+#include "cryptonote_config.h"
+#include "crypto.h"
+#include "string_tools.h"
+#include "pruned_block_store.hpp"
+
+using namespace std;
+//
+using namespace decoy_picker;
+
+namespace {
+	// As in wallet2
+	const double GAMMA_SHAPE = 19.28;
+	const double GAMMA_SCALE = 1 / 1.61;
+	const uint64_t DEFAULT_UNLOCK_TIME = CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE * DIFFICULTY_TARGET_V2;
+	const double RECENT_SPEND_WINDOW = 15 * DIFFICULTY_TARGET_V2;
+	const uint64_t BLOCKS_IN_A_YEAR = 86400 * 365 / DIFFICULTY_TARGET_V2;
+
+	const size_t MAX_ATTEMPTS_PER_DECOY = 100;
+
+	typedef pruned_block_store::Reader::OutputRef OutputRef;
+
+	// A stored block's outputs: consecutive global indices, at consecutive positions of the sorted outputs
+	struct BlockOutputs
+	{
+		uint64_t height;
+		uint64_t first_global_index;
+		size_t first; // into outputs
+		size_t count;
+	};
+
+	// Whether b is the next block after a, with no output missing between them
+	bool contiguous(const BlockOutputs &a, const BlockOutputs &b)
+	{
+		return a.height + 1 == b.height && a.first_global_index + a.count == b.first_global_index;
+	}
+
+	// As the daemon's is_tx_spendtime_unlocked() at the given chain height, less its allowed deltas. Its clock for
+	// time locks is the median of recent block timestamps, which trails this one, so it is given a window's slack.
+	bool is_unlocked(uint64_t unlock_time, uint64_t blockchain_height)
+	{
+		if (unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER) {
+			return blockchain_height - 1 >= unlock_time;
+		}
+		return uint64_t(time(nullptr)) >= unlock_time + BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW * DIFFICULTY_TARGET_V2;
+	}
+
+	enum PickResult
+	{
+		Picked,
+		Redraw, // as wallet2 does, e.g. for an age past the first rct output
+		NotStored // an age past the oldest stored block, which wallet2 would have picked from
+	};
+
+	// wallet2's gamma_picker: an age in seconds becomes an offset from the newest spendable output through the
+	// average time between outputs, then the pick is any output of the block holding that offset. Here the
+	// blocks are the gap free run of stored blocks up to the newest spendable one.
+	class GammaPicker
+	{
+	public:
+		GammaPicker(const vector<BlockOutputs> &blocks, double average_output_time)
+			: m_blocks(blocks)
+			, m_average_output_time(average_output_time)
+			, m_engine(crypto::rand<uint64_t>())
+			, m_gamma(GAMMA_SHAPE, GAMMA_SCALE)
+		{
+		}
+
+		// Sets index, into outputs, when Picked
+		PickResult pick(size_t &index)
+		{
+			double x = exp(m_gamma(m_engine));
+			if (x > DEFAULT_UNLOCK_TIME) {
+				x -= DEFAULT_UNLOCK_TIME; // only spendable outputs are in the set, so shift the distribution
+			} else {
+				x = crypto::rand_idx(static_cast<uint64_t>(ceil(RECENT_SPEND_WINDOW)));
+			}
+
+			const BlockOutputs &newest = m_blocks.back();
+			const uint64_t outputs_end = newest.first_global_index + newest.count; // all rct outputs spendable so far
+			const uint64_t offset = static_cast<uint64_t>(x / m_average_output_time);
+			if (offset >= outputs_end) {
+				return Redraw;
+			}
+			const uint64_t target = outputs_end - 1 - offset;
+			if (target < m_blocks.front().first_global_index) {
+				return NotStored;
+			}
+
+			auto it = upper_bound(m_blocks.begin(), m_blocks.end(), target, [](uint64_t gi, const BlockOutputs &b) { return gi < b.first_global_index; });
+			--it; // target is at or past the first block
+			index = it->first + crypto::rand_idx(it->count);
+			return Picked;
+		}
+
+	private:
+		const vector<BlockOutputs> &m_blocks;
+		double m_average_output_time;
+		mt19937_64 m_engine;
+		gamma_distribution<double> m_gamma;
+	};
+}
+
+bool decoy_picker::get_random_outs(
+	const string &storage_path,
+	uint64_t blockchain_height,
+	const vector<string> &amounts,
+	size_t count,
+	const vector<uint64_t> &exclude,
+	vector<monero_transfer_utils::RandomAmountOutputs> &mix_outs,
+	string &err_msg
+) {
+	mix_outs.clear();
+	for (const auto &amount : amounts) {
+		if (amount != "0") {
+			err_msg = "Local decoys are only available for RingCT outputs";
+			return false;
+		}
+	}
+	if (amounts.empty()) {
+		return true;
+	}
+
+	pruned_block_store::Reader reader(storage_path);
+	vector<OutputRef> outputs;
+	reader.outputs(outputs);
+	sort(outputs.begin(), outputs.end(), [](const OutputRef &a, const OutputRef &b) { return a.global_index < b.global_index; });
+	outputs.erase(unique(outputs.begin(), outputs.end(), [](const OutputRef &a, const OutputRef &b) { return a.global_index == b.global_index; }), outputs.end());
+
+	// Blocks missing some of their outputs (a sampled store keeps only some of the txs, a Clarity feed has no
+	// miner txs) are split at the gaps, which then break the run of contiguous blocks below
+	vector<BlockOutputs> blocks;
+	for (size_t i = 0; i < outputs.size(); i++) {
+		const OutputRef &o = outputs[i];
+		if (blocks.empty() || blocks.back().height != o.block_height || blocks.back().first_global_index + blocks.back().count != o.global_index) {
+			blocks.push_back(BlockOutputs{o.block_height, o.global_index, i, 0});
+		}
+		blocks.back().count++;
+	}
+
+	// As in wallet2, the newest spendable block is the one CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE blocks back from
+	// the chain tip. The store has to hold it and the block after, which shows it is whole, so it can be no more
+	// than a few blocks behind the chain. Then back from it as long as every block is there, whole.
+	if (blockchain_height <= CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE + 1) {
+		err_msg = "Invalid blockchain height";
+		return false;
+	}
+	const uint64_t newest_spendable_height = blockchain_height - 1 - CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE;
+	size_t last = blocks.size();
+	while (last > 0 && blocks[last - 1].height > newest_spendable_height) {
+		last--;
+	}
+	if (last == 0 || last == blocks.size() || blocks[last - 1].height != newest_spendable_height || !contiguous(blocks[last - 1], blocks[last])) {
+		err_msg = "Local storage does not reach the chain tip, pass mix_outs from the server instead";
+		return false;
+	}
+	size_t first = last - 1;
+	while (first > 0 && contiguous(blocks[first - 1], blocks[first])) {
+		first--;
+	}
+	if (blocks[first].first_global_index != 0) {
+		first++; // the first block of the run may be missing outputs at its start, unless it starts at the first rct output
+	}
+	// Like wallet2, which picks from the per-block output counts of the whole chain, anything less than a
+	// year of blocks would skew the distribution; those decoys have to come from the server instead
+	if (last - first < BLOCKS_IN_A_YEAR) {
+		err_msg = "Local storage does not hold every block of the last year, pass mix_outs from the server instead";
+		return false;
+	}
+	blocks.erase(blocks.begin() + last, blocks.end());
+	blocks.erase(blocks.begin(), blocks.begin() + first);
+
+	// Average time between outputs over the last year
+	const BlockOutputs &year_begin = blocks[blocks.size() - BLOCKS_IN_A_YEAR];
+	const uint64_t outputs_in_a_year = blocks.back().first_global_index + blocks.back().count - year_begin.first_global_index;
+	const double average_output_time = double(DIFFICULTY_TARGET_V2) * BLOCKS_IN_A_YEAR / outputs_in_a_year;
+
+	GammaPicker picker(blocks, average_output_time);
+	const unordered_set<uint64_t> excluded(exclude.begin(), exclude.end());
+
+	mix_outs.reserve(amounts.size());
+	for (size_t i = 0; i < amounts.size(); i++) {
+		monero_transfer_utils::RandomAmountOutputs amount_outs{};
+		amount_outs.amount = 0;
+
+		unordered_set<size_t> picked;
+		for (size_t attempts = 0; amount_outs.outputs.size() < count && attempts < count * MAX_ATTEMPTS_PER_DECOY; attempts++) {
+			size_t index;
+			const PickResult result = picker.pick(index);
+			if (result == NotStored) {
+				// redrawing would cut off the tail of the distribution, which wallet2 covers
+				err_msg = "Local storage does not hold every block back to the first RingCT output, pass mix_outs from the server instead";
+				mix_outs.clear();
+				return false;
+			}
+			if (result == Redraw) {
+				continue;
+			}
+			// wallet2 leaves out what the daemon reports as locked, coinbase outputs included
+			const OutputRef &o = outputs[index];
+			if (o.rct_kind == pruned_block_store::RctNone
+				|| (o.rct_kind == pruned_block_store::RctCoinbase && o.block_height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW > blockchain_height - 1)
+				|| !is_unlocked(o.unlock_time, blockchain_height)
+				|| excluded.count(o.global_index) != 0 || !picked.insert(index).second) {
+				continue;
+			}
+
+			serial_bridge::Mixin mixin;
+			if (!pruned_block_store::Reader::decode(outputs[index].record, mixin)) {
+				continue;
+			}
+			monero_transfer_utils::RandomAmountOutput out{};
+			out.global_index = mixin.global_index;
+			out.public_key = epee::string_tools::pod_to_hex(mixin.public_key);
+			out.rct = mixin.rct.hex();
+			amount_outs.outputs.push_back(std::move(out));
+		}
+		if (amount_outs.outputs.size() < count) {
+			err_msg = "Not enough outputs in local storage";
+			mix_outs.clear();
+			return false;
+		}
+		mix_outs.push_back(std::move(amount_outs));
+	}
+	return true;
+}
@@ -0,0 +1,41 @@
+//
+//  decoy_picker.hpp
+//
+//  Local replacement for the get_random_outs round trip: picks decoys from
+//  the outputs the scanner persisted in the binary pruned-block store, the
+//  way wallet2 does. That takes a store with every block from the first
+//  RingCT output up to the chain tip, written by scans of the binary
+//  /get_blocks.bin feed with "storage_format": "binary" and
+//  "storage_percent": 100. A sampled store, or one filled from the Clarity
+//  feed, which has no miner txs, is refused.
+//
+
+#ifndef decoy_picker_hpp
+#define decoy_picker_hpp
+
+#include <string>
+#include <vector>
+//
+#include "monero_transfer_utils.hpp"
+
+namespace decoy_picker
+{
+	using namespace std;
+
+	// Same shape as a get_random_outs request/response: `count` outputs for each entry of `amounts`. Only RingCT
+	// outputs (amount "0") are stored, so anything else is an error, as is a store that is more than a few blocks
+	// behind `blockchain_height` or has gaps. The decoys then have to come from the server. A store that only
+	// goes back a year or more can still be refused when a pick lands before it. Outputs in `exclude` (global
+	// indices of the real outputs being spent) and locked outputs are never picked.
+	bool get_random_outs(
+		const string &storage_path,
+		uint64_t blockchain_height,
+		const vector<string> &amounts,
+		size_t count,
+		const vector<uint64_t> &exclude,
+		vector<monero_transfer_utils::RandomAmountOutputs> &mix_outs,
+		string &err_msg
+	);
+}
+
+#endif /* decoy_picker_hpp */
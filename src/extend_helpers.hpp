@@ -28,6 +28,10 @@ namespace extend_helpers {
 
 
     void decode_base64(const string &input, string &out);
+    // Decodes into out, reusing its capacity
+    void decode_base64(const char *input, size_t in_len, string &out);
+    // Whether decode_base64() would take the input, checked without decoding it
+    bool is_base64(const char *input, size_t in_len);
 };
 
 #endif /* extend_helpers_hpp */
@@ -0,0 +1,298 @@
+//
+//  json_reader.cpp
+//
+#include "json_reader.hpp"
+//
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+//
+using namespace json_reader;
+
+namespace {
+	bool is_whitespace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+	bool is_number_char(char c)
+	{
+		return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+	}
+	int hex_value(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+	bool read_hex4(const char *&pos, const char *end, uint32_t &out)
+	{
+		if (end - pos < 4) return false;
+		out = 0;
+		for (int i = 0; i < 4; i++) {
+			int v = hex_value(*pos++);
+			if (v < 0) return false;
+			out = (out << 4) | v;
+		}
+		return true;
+	}
+	void append_utf8(std::string &out, uint32_t cp)
+	{
+		if (cp < 0x80) {
+			out.push_back(static_cast<char>(cp));
+		} else if (cp < 0x800) {
+			out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+			out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+		} else if (cp < 0x10000) {
+			out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+			out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+		} else {
+			out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+			out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+		}
+	}
+	bool parse_uint64(boost::string_ref digits, uint64_t &out)
+	{
+		if (digits.empty()) return false;
+		uint64_t v = 0;
+		for (char c : digits) {
+			if (c < '0' || c > '9') return false;
+			const uint64_t d = c - '0';
+			if (v > (UINT64_MAX - d) / 10) return false; // overflow
+			v = v * 10 + d;
+		}
+		out = v;
+		return true;
+	}
+}
+//
+bool json_reader::unescape(boost::string_ref raw, std::string &out)
+{
+	out.clear();
+	out.reserve(raw.size());
+	const char *pos = raw.data();
+	const char *end = pos + raw.size();
+	while (pos != end) {
+		const char *backslash = static_cast<const char *>(memchr(pos, '\\', end - pos));
+		if (backslash == NULL) {
+			out.append(pos, end - pos);
+			break;
+		}
+		out.append(pos, backslash - pos);
+		pos = backslash + 1;
+		if (pos == end) return false;
+		const char c = *pos++;
+		switch (c) {
+			case '"': out.push_back('"'); break;
+			case '\\': out.push_back('\\'); break;
+			case '/': out.push_back('/'); break;
+			case 'b': out.push_back('\b'); break;
+			case 'f': out.push_back('\f'); break;
+			case 'n': out.push_back('\n'); break;
+			case 'r': out.push_back('\r'); break;
+			case 't': out.push_back('\t'); break;
+			case 'u': {
+				uint32_t cp;
+				if (!read_hex4(pos, end, cp)) return false;
+				if (cp >= 0xD800 && cp <= 0xDBFF) { // high surrogate; must be followed by a low one
+					uint32_t low;
+					if (end - pos < 2 || pos[0] != '\\' || pos[1] != 'u') return false;
+					pos += 2;
+					if (!read_hex4(pos, end, low) || low < 0xDC00 || low > 0xDFFF) return false;
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				} else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+					return false;
+				}
+				append_utf8(out, cp);
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+//
+Reader::Reader(const char *buffer, size_t length)
+	: m_pos(buffer)
+	, m_end(buffer + length)
+{
+}
+//
+Event Reader::fail()
+{
+	m_failed = true;
+	return Error;
+}
+void Reader::after_value()
+{
+	m_expect = m_stack.empty() ? ExpectEnd : ExpectCommaOrClose;
+}
+Event Reader::close(char container)
+{
+	if (m_stack.empty() || m_stack.back() != container) {
+		return fail();
+	}
+	m_pos++;
+	m_stack.pop_back();
+	after_value();
+	return container == '{' ? EndObject : EndArray;
+}
+bool Reader::read_string()
+{ // m_pos is on the opening quote
+	const char *start = ++m_pos;
+	bool has_escapes = false;
+	while (m_pos != m_end) {
+		const char c = *m_pos;
+		if (c == '"') {
+			m_raw = boost::string_ref(start, m_pos - start);
+			m_raw_has_escapes = has_escapes;
+			m_pos++;
+			return true;
+		}
+		if (c == '\\') { // the escape itself is validated when unescaping
+			has_escapes = true;
+			if (m_end - m_pos < 2) return false;
+			m_pos += 2;
+			continue;
+		}
+		if (static_cast<unsigned char>(c) < 0x20) return false;
+		m_pos++;
+	}
+	return false;
+}
+bool Reader::read_literal(const char *literal)
+{
+	const size_t n = strlen(literal);
+	if (static_cast<size_t>(m_end - m_pos) < n || memcmp(m_pos, literal, n) != 0) {
+		return false;
+	}
+	m_pos += n;
+	return true;
+}
+//
+Event Reader::next()
+{
+	if (m_failed) {
+		return Error;
+	}
+	for (;;) {
+		while (m_pos != m_end && is_whitespace(*m_pos)) {
+			m_pos++;
+		}
+		if (m_pos == m_end) {
+			return m_expect == ExpectEnd ? End : fail();
+		}
+		const char c = *m_pos;
+		switch (m_expect) {
+			case ExpectEnd:
+				return fail(); // trailing garbage
+			case ExpectColon:
+				if (c != ':') return fail();
+				m_pos++;
+				m_expect = ExpectValue;
+				continue;
+			case ExpectCommaOrClose:
+				if (c == ',') {
+					m_pos++;
+					m_expect = m_stack.back() == '{' ? ExpectKey : ExpectValue;
+					m_first = false;
+					continue;
+				}
+				if (c == '}') return close('{');
+				if (c == ']') return close('[');
+				return fail();
+			case ExpectKey:
+				if (c == '}' && m_first) return close('{');
+				if (c != '"' || !read_string()) return fail();
+				m_expect = ExpectColon;
+				return Key;
+			case ExpectValue:
+				break;
+		}
+		switch (c) {
+			case '{':
+				m_pos++;
+				m_stack.push_back('{');
+				m_expect = ExpectKey;
+				m_first = true;
+				return BeginObject;
+			case '[':
+				m_pos++;
+				m_stack.push_back('[');
+				m_expect = ExpectValue;
+				m_first = true;
+				return BeginArray;
+			case ']':
+				if (!m_first) return fail(); // trailing comma
+				return close('[');
+			case '"':
+				if (!read_string()) return fail();
+				after_value();
+				return String;
+			case 't':
+				if (!read_literal("true")) return fail();
+				after_value();
+				return True;
+			case 'f':
+				if (!read_literal("false")) return fail();
+				after_value();
+				return False;
+			case 'n':
+				if (!read_literal("null")) return fail();
+				after_value();
+				return Null;
+			default: {
+				if (c != '-' && (c < '0' || c > '9')) return fail();
+				const char *start = m_pos;
+				while (m_pos != m_end && is_number_char(*m_pos)) {
+					m_pos++;
+				}
+				m_raw = boost::string_ref(start, m_pos - start);
+				m_raw_has_escapes = false;
+				after_value();
+				return Number;
+			}
+		}
+	}
+}
+//
+bool Reader::string_value(std::string &out) const
+{
+	if (!m_raw_has_escapes) {
+		out.assign(m_raw.data(), m_raw.size());
+		return true;
+	}
+	return unescape(m_raw, out);
+}
+bool Reader::uint64_value(uint64_t &out) const
+{
+	if (!m_raw_has_escapes) {
+		return parse_uint64(m_raw, out);
+	}
+	std::string unescaped;
+	return unescape(m_raw, unescaped) && parse_uint64(unescaped, out);
+}
+bool Reader::is(const char *str) const
+{
+	if (!m_raw_has_escapes) {
+		return m_raw == str;
+	}
+	std::string unescaped;
+	return unescape(m_raw, unescaped) && unescaped == str;
+}
+bool Reader::skip(Event event)
+{
+	if (event != BeginObject && event != BeginArray) {
+		return event != Error;
+	}
+	const size_t depth = m_stack.size();
+	while (m_stack.size() >= depth) {
+		if (next() == Error) return false;
+	}
+	return true;
+}
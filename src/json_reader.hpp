@@ -0,0 +1,92 @@
+//
+//  json_reader.hpp
+//
+//  Incremental, event based JSON reader working directly on the caller's
+//  buffer. Unlike boost::property_tree it never builds a document; callers pull
+//  one event at a time and only copy out the values they need.
+//
+
+#ifndef json_reader_hpp
+#define json_reader_hpp
+
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+
+namespace json_reader
+{
+	using namespace std;
+
+	enum Event
+	{
+		BeginObject,
+		EndObject,
+		BeginArray,
+		EndArray,
+		Key,
+		String,
+		Number,
+		True,
+		False,
+		Null,
+		End, // the top level value has been read completely
+		Error
+	};
+
+	class Reader
+	{
+	public:
+		// The buffer must outlive the reader and every view it hands out
+		Reader(const char *buffer, size_t length);
+
+		Event next();
+
+		// After Key, String or Number: the raw text between the quotes (or of the number)
+		boost::string_ref raw() const { return m_raw; }
+		bool raw_has_escapes() const { return m_raw_has_escapes; }
+		//
+		// After Key or String: the value with escapes resolved; returns false on a malformed escape
+		bool string_value(std::string &out) const;
+		// After Number or String: accepts numeric strings as well, like ptree's get<uint64_t>()
+		bool uint64_value(uint64_t &out) const;
+		// After Key or String: compares the unescaped value without copying it
+		bool is(const char *str) const;
+
+		// Skips the rest of the value whose first event was just returned; a no-op for scalars
+		bool skip(Event event);
+
+		size_t depth() const { return m_stack.size(); }
+		bool failed() const { return m_failed; }
+
+	private:
+		enum Expect
+		{
+			ExpectValue,
+			ExpectKey,
+			ExpectColon,
+			ExpectCommaOrClose,
+			ExpectEnd
+		};
+
+		Event fail();
+		Event close(char container);
+		void after_value();
+		bool read_string();
+		bool read_literal(const char *literal);
+
+		const char *m_pos;
+		const char *m_end;
+
+		std::vector<char> m_stack; // '{' or '['
+		Expect m_expect = ExpectValue;
+		bool m_first = true; // no element read yet in the innermost container
+		bool m_failed = false;
+
+		boost::string_ref m_raw;
+		bool m_raw_has_escapes = false;
+	};
+
+	bool unescape(boost::string_ref raw, std::string &out);
+}
+
+#endif /* json_reader_hpp */
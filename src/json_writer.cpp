@@ -0,0 +1,200 @@
+//
+//  json_writer.cpp
+//
+#include "json_writer.hpp"
+
+using namespace std;
+//
+using namespace json_writer;
+
+namespace {
+	// Characters write_json escapes: control characters, '"', '/' and '\\'. Everything from 0x7F up is copied as is.
+	inline bool needs_escape(unsigned char c)
+	{
+		return c < 0x20 || c == '"' || c == '/' || c == '\\';
+	}
+
+	const char DIGIT_PAIRS[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+
+	void write_tree(Writer &writer, const boost::property_tree::ptree &tree, bool top)
+	{
+		if (!top && tree.empty()) {
+			writer.value(tree.data());
+		} else if (!top && tree.count("") == tree.size()) {
+			writer.begin_array();
+			for (const auto &child : tree) {
+				write_tree(writer, child.second, false);
+			}
+			writer.end_array();
+		} else {
+			writer.begin_object();
+			for (const auto &child : tree) {
+				writer.key(child.first);
+				write_tree(writer, child.second, false);
+			}
+			writer.end_object();
+		}
+	}
+}
+//
+void Writer::begin_object()
+{
+	begin_value();
+	m_stack.push_back({ m_out.size(), true, true });
+	m_out += '{';
+}
+void Writer::end_object()
+{
+	const Container container = m_stack.back();
+	m_stack.pop_back();
+	if (container.empty && !m_stack.empty()) {
+		m_out.resize(container.begin);
+		m_out += "\"\"";
+	} else {
+		m_out += '}';
+	}
+}
+void Writer::begin_array()
+{
+	begin_value();
+	m_stack.push_back({ m_out.size(), false, true });
+	m_out += '[';
+}
+void Writer::end_array()
+{
+	const Container container = m_stack.back();
+	m_stack.pop_back();
+	if (container.empty && !m_stack.empty()) {
+		m_out.resize(container.begin);
+		m_out += "\"\"";
+	} else {
+		m_out += ']';
+	}
+}
+void Writer::key(boost::string_ref key)
+{
+	Container &container = m_stack.back();
+	if (!container.empty) {
+		m_out += ',';
+	}
+	container.empty = false;
+
+	m_out += '"';
+	escaped(key);
+	m_out += "\":";
+}
+void Writer::value(boost::string_ref value)
+{
+	begin_value();
+	m_out += '"';
+	escaped(value);
+	m_out += '"';
+}
+void Writer::value(bool value)
+{
+	begin_value();
+	m_out += value ? "\"true\"" : "\"false\"";
+}
+void Writer::uint64_value(uint64_t value)
+{
+	begin_value();
+
+	char buffer[20];
+	char *end = buffer + sizeof(buffer);
+	char *p = end;
+	while (value >= 100) {
+		const unsigned pair = static_cast<unsigned>(value % 100) * 2;
+		value /= 100;
+		*--p = DIGIT_PAIRS[pair + 1];
+		*--p = DIGIT_PAIRS[pair];
+	}
+	if (value >= 10) {
+		const unsigned pair = static_cast<unsigned>(value) * 2;
+		*--p = DIGIT_PAIRS[pair + 1];
+		*--p = DIGIT_PAIRS[pair];
+	} else {
+		*--p = static_cast<char>('0' + value);
+	}
+
+	m_out += '"';
+	m_out.append(p, end - p);
+	m_out += '"';
+}
+void Writer::hex_value(const void *data, size_t size)
+{
+	static const char hexdigits[] = "0123456789abcdef";
+
+	begin_value();
+
+	const size_t begin = m_out.size();
+	m_out.resize(begin + 2 + size * 2);
+	char *out = &m_out[begin];
+	*out++ = '"';
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	for (size_t i = 0; i < size; i++) {
+		*out++ = hexdigits[bytes[i] >> 4];
+		*out++ = hexdigits[bytes[i] & 0x0F];
+	}
+	*out = '"';
+}
+void Writer::tree(const boost::property_tree::ptree &tree)
+{
+	write_tree(*this, tree, m_stack.empty());
+}
+void Writer::finish()
+{
+	m_out += '\n';
+}
+//
+void Writer::begin_value()
+{
+	// Object members are separated in key()
+	if (!m_stack.empty() && !m_stack.back().object) {
+		Container &container = m_stack.back();
+		if (!container.empty) {
+			m_out += ',';
+		}
+		container.empty = false;
+	}
+}
+void Writer::escaped(boost::string_ref str)
+{
+	static const char hexdigits[] = "0123456789ABCDEF";
+
+	size_t run = 0;
+	for (size_t i = 0; i < str.size(); i++) {
+		const unsigned char c = static_cast<unsigned char>(str[i]);
+		if (!needs_escape(c)) {
+			continue;
+		}
+		m_out.append(str.data() + run, i - run);
+		run = i + 1;
+
+		switch (c) {
+			case '\b': m_out += "\\b"; break;
+			case '\f': m_out += "\\f"; break;
+			case '\n': m_out += "\\n"; break;
+			case '\r': m_out += "\\r"; break;
+			case '\t': m_out += "\\t"; break;
+			case '/': m_out += "\\/"; break;
+			case '"': m_out += "\\\""; break;
+			case '\\': m_out += "\\\\"; break;
+			default:
+				m_out += "\\u00";
+				m_out += hexdigits[c >> 4];
+				m_out += hexdigits[c & 0x0F];
+				break;
+		}
+	}
+	m_out.append(str.data() + run, str.size() - run);
+}
@@ -0,0 +1,79 @@
+//
+//  json_writer.hpp
+//
+//  Streaming JSON writer appending straight into a caller owned string, for
+//  responses too large to build as a boost::property_tree first.
+//
+//  The output is byte for byte what write_json(stream, tree, false) gives for
+//  the equivalent tree, since that is what clients have always parsed:
+//  every scalar is a quoted string, empty arrays and objects below the top
+//  level are written as "", '/' and control characters are escaped the way
+//  boost escapes them, and the document ends with a newline.
+//
+
+#ifndef json_writer_hpp
+#define json_writer_hpp
+
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace json_writer
+{
+	using namespace std;
+
+	class Writer
+	{
+	public:
+		// Appends to out; clear it first to reuse its capacity for a new document
+		explicit Writer(std::string &out) : m_out(out) {}
+
+		void begin_object();
+		void end_object();
+		void begin_array();
+		void end_array();
+
+		void key(boost::string_ref key);
+		void value(boost::string_ref value);
+		void value(const char *value) { this->value(boost::string_ref(value)); }
+		void value(const std::string &value) { this->value(boost::string_ref(value)); }
+		void value(bool value);
+		template<typename T>
+		typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type value(T value) { uint64_value(value); }
+		void uint64_value(uint64_t value);
+		// Lowercase hex of size bytes, like epee::string_tools::pod_to_hex
+		void hex_value(const void *data, size_t size);
+		template<typename T>
+		void pod_value(const T &pod) { hex_value(&pod, sizeof(pod)); }
+
+		// key() and value() in one
+		template<typename T>
+		void member(boost::string_ref name, const T &v) { key(name); value(v); }
+		template<typename T>
+		void pod_member(boost::string_ref name, const T &pod) { key(name); pod_value(pod); }
+
+		// Writes a property tree the way write_json would, so ptree built parts can be mixed in
+		void tree(const boost::property_tree::ptree &tree);
+
+		// Ends the document; the top level value must be complete
+		void finish();
+
+	private:
+		void begin_value();
+		void escaped(boost::string_ref str);
+
+		struct Container
+		{
+			size_t begin; // offset of the opening bracket
+			bool object;
+			bool empty;
+		};
+
+		std::string &m_out;
+		std::vector<Container> m_stack;
+	};
+}
+
+#endif /* json_writer_hpp */
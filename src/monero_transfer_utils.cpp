@@ -151,6 +151,37 @@ bool _verify_sec_key(const crypto::secret_key &secret_key, const crypto::public_
 	bool r = crypto::secret_key_to_public_key(secret_key, calculated_pub);
 	return r && public_key == calculated_pub;
 }
+bool _subaddresses_of_sources(
+	const account_keys &sender_account_keys,
+	const subaddress_table::SubaddressTable &subaddresses,
+	const std::vector<cryptonote::tx_source_entry> &sources,
+	std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &source_subaddresses
+) {
+	hw::device &hwdev = sender_account_keys.get_device();
+	for (const auto &src : sources) {
+		const crypto::public_key out_key = rct::rct2pk(src.outputs[src.real_output].second.dest);
+
+		std::vector<crypto::key_derivation> additional_derivations;
+		for (const auto &additional_pub : src.real_out_additional_tx_keys) {
+			crypto::key_derivation additional_derivation;
+			if (!hwdev.generate_key_derivation(additional_pub, sender_account_keys.m_view_secret_key, additional_derivation)) {
+				return false;
+			}
+			additional_derivations.push_back(additional_derivation);
+		}
+		crypto::key_derivation derivation;
+		if (!hwdev.generate_key_derivation(src.real_out_tx_key, sender_account_keys.m_view_secret_key, derivation)) {
+			return false;
+		}
+
+		auto recv_info = subaddress_table::is_out_to_acc_precomp(subaddresses, out_key, derivation, additional_derivations, src.real_output_in_tx_index, hwdev);
+		if (!recv_info) {
+			return false;
+		}
+		source_subaddresses[hwdev.get_subaddress_spend_public_key(sender_account_keys, recv_info->index)] = recv_info->index;
+	}
+	return true;
+}
 } // unnamed namespace
 //
 namespace
@@ -502,7 +533,7 @@ void monero_transfer_utils::create_transaction(
 	TransactionConstruction_RetVals &retVals,
 	const account_keys& sender_account_keys, // this will reference a particular hw::device
 	const uint32_t subaddr_account_idx,
-	const std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses,
+	const subaddress_table::SubaddressTable &subaddresses,
 	const address_parse_info &to_addr, 
 	uint64_t sending_amount,
 	uint64_t change_amount,
@@ -750,8 +781,15 @@ void monero_transfer_utils::create_transaction(
 	cryptonote::transaction tx;
 	crypto::secret_key tx_key;
 	std::vector<crypto::secret_key> additional_tx_keys;
+	// construct_tx only looks up the subaddresses the real inputs were received on, so it gets a small map of
+	// those rather than a copy of the whole table
+	std::unordered_map<crypto::public_key, cryptonote::subaddress_index> source_subaddresses;
+	if (!_subaddresses_of_sources(sender_account_keys, subaddresses, sources, source_subaddresses)) {
+		retVals.errCode = transactionNotConstructed;
+		return;
+	}
 	bool r = cryptonote::construct_tx_and_get_tx_key(
-		sender_account_keys, subaddresses,
+		sender_account_keys, source_subaddresses,
 		sources, splitted_dsts, change_dst.addr, extra,
 		tx, unlock_time, tx_key, additional_tx_keys,
 		true, rct_config, true
@@ -850,7 +888,7 @@ void monero_transfer_utils::convenience__create_transaction(
 	}
 	//
 	uint32_t subaddr_account_idx = 0;
-	std::unordered_map<crypto::public_key, cryptonote::subaddress_index> subaddresses;
+	subaddress_table::SubaddressTable subaddresses;
 	cryptonote::subaddress_index index = {0, 0};
 	serial_bridge::expand_subaddresses(account_keys, subaddresses, index, subaddresses_count);
 
@@ -41,6 +41,7 @@
 #include "cryptonote_format_utils.h"
 #include "cryptonote_tx_utils.h"
 #include "ringct/rctSigs.h"
+#include "subaddress_table.hpp"
 //
 #include "monero_fork_rules.hpp"
 #include "monero_fee_utils.hpp"
@@ -307,7 +308,7 @@ namespace monero_transfer_utils
 		TransactionConstruction_RetVals &retVals,
 		const account_keys& sender_account_keys, // this will reference a particular hw::device
 		const uint32_t subaddr_account_idx, // pass 0 for no subaddrs
-		const std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses,
+		const subaddress_table::SubaddressTable &subaddresses, // only the entries the sources belong to are handed on to construct_tx
 		const address_parse_info &to_addr, // this _must_ include correct .is_subaddr
 		uint64_t sending_amount,
 		uint64_t change_amount,
@@ -0,0 +1,155 @@
+//
+//  owner_set.hpp
+//
+//  Flat open-addressing set of (key, owner) pairs over raw 32-byte keys such
+//  as crypto::key_image or crypto::hash, for looking up which wallet accounts
+//  a key belongs to with a single probe sequence and no allocations.
+//
+
+#ifndef owner_set_hpp
+#define owner_set_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace owner_set
+{
+	using namespace std;
+
+	template<typename Key>
+	class OwnerSet
+	{
+	public:
+		typedef uint32_t Owner;
+
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		void reserve(size_t count)
+		{
+			size_t capacity = 16;
+			while (capacity * max_load_num < count * max_load_den) {
+				capacity *= 2;
+			}
+			if (capacity > m_slots.size()) {
+				rehash(capacity);
+			}
+		}
+
+		// A key may have several owners (the same wallet added twice); inserting an existing pair is a no-op
+		void insert(const Key &key, Owner owner)
+		{
+			if ((m_used + 1) * max_load_den > m_slots.size() * max_load_num) {
+				rehash(m_size * 2 * max_load_den / max_load_num + 16);
+			}
+
+			size_t tombstone = npos;
+			for (size_t i = slot_of(key);; i = (i + 1) & mask()) {
+				Slot &slot = m_slots[i];
+				if (slot.state == Empty) {
+					Slot &target = tombstone != npos ? m_slots[tombstone] : slot;
+					if (tombstone == npos) {
+						m_used++;
+					}
+					target.key = key;
+					target.owner = owner;
+					target.state = Full;
+					m_size++;
+					return;
+				}
+				if (slot.state == Deleted) {
+					if (tombstone == npos) {
+						tombstone = i;
+					}
+				} else if (slot.owner == owner && equal(slot.key, key)) {
+					return;
+				}
+			}
+		}
+
+		// Calls fn(owner) for every owner of key
+		template<typename F>
+		void for_each_owner(const Key &key, F fn) const
+		{
+			if (m_size == 0) {
+				return;
+			}
+			for (size_t i = slot_of(key); m_slots[i].state != Empty; i = (i + 1) & mask()) {
+				const Slot &slot = m_slots[i];
+				if (slot.state == Full && equal(slot.key, key)) {
+					fn(slot.owner);
+				}
+			}
+		}
+
+		// Removes key for all its owners, calling fn(owner) for each
+		template<typename F>
+		void erase_all(const Key &key, F fn)
+		{
+			if (m_size == 0) {
+				return;
+			}
+			for (size_t i = slot_of(key); m_slots[i].state != Empty; i = (i + 1) & mask()) {
+				Slot &slot = m_slots[i];
+				if (slot.state == Full && equal(slot.key, key)) {
+					slot.state = Deleted;
+					m_size--;
+					fn(slot.owner);
+				}
+			}
+		}
+
+	private:
+		enum State : uint8_t { Empty = 0, Full, Deleted };
+		struct Slot
+		{
+			Key key;
+			Owner owner;
+			State state;
+		};
+
+		static const size_t npos = size_t(-1);
+		// Probes stop at empty slots only, so tombstones count towards the load
+		static const size_t max_load_num = 7;
+		static const size_t max_load_den = 8;
+
+		size_t mask() const { return m_slots.size() - 1; }
+
+		// The keys are hashes or curve points, so their leading bytes are already uniformly distributed
+		size_t slot_of(const Key &key) const
+		{
+			uint64_t h;
+			static_assert(sizeof(Key) >= sizeof(h), "keys must be at least 8 bytes");
+			memcpy(&h, &key, sizeof(h));
+			return static_cast<size_t>(h) & mask();
+		}
+		static bool equal(const Key &a, const Key &b)
+		{
+			return memcmp(&a, &b, sizeof(Key)) == 0;
+		}
+
+		void rehash(size_t min_capacity)
+		{
+			size_t capacity = 16;
+			while (capacity < min_capacity) {
+				capacity *= 2;
+			}
+			std::vector<Slot> slots(capacity);
+			slots.swap(m_slots);
+			m_size = 0;
+			m_used = 0;
+			for (const Slot &slot : slots) {
+				if (slot.state == Full) {
+					insert(slot.key, slot.owner);
+				}
+			}
+		}
+
+		std::vector<Slot> m_slots; // power of two sized
+		size_t m_size = 0; // full slots
+		size_t m_used = 0; // full and deleted slots
+	};
+}
+
+#endif /* owner_set_hpp */
@@ -0,0 +1,451 @@
+//
+//  pruned_block_store.cpp
+//
+#include "pruned_block_store.hpp"
+//
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <iterator>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+//
+#include "common/int-util.h"
+
+using namespace std;
+//
+using namespace pruned_block_store;
+
+namespace {
+	const char RECORDS_MAGIC[8] = { 'M', 'M', 'P', 'B', 'D', 'A', 'T', '1' };
+	const char INDEX_MAGIC[8] = { 'M', 'M', 'P', 'B', 'I', 'D', 'X', '1' };
+
+	void put_u64(unsigned char *dst, uint64_t v)
+	{
+		v = SWAP64LE(v);
+		memcpy(dst, &v, sizeof(v));
+	}
+	uint64_t get_u64(const unsigned char *src)
+	{
+		uint64_t v;
+		memcpy(&v, src, sizeof(v));
+		return SWAP64LE(v);
+	}
+
+	void put_unlock_time(unsigned char *dst, uint64_t unlock_time)
+	{
+		unlock_time = std::min(unlock_time, MAX_UNLOCK_TIME);
+		for (size_t i = 0; i < 7; i++) {
+			dst[i] = static_cast<unsigned char>(unlock_time >> (8 * i));
+		}
+	}
+	uint64_t get_unlock_time(const unsigned char *src)
+	{
+		uint64_t unlock_time = 0;
+		for (size_t i = 0; i < 7; i++) {
+			unlock_time |= uint64_t(src[i]) << (8 * i);
+		}
+		return unlock_time;
+	}
+
+	bool encode_record(const serial_bridge::Mixin &mixin, unsigned char *record)
+	{
+		memset(record, 0, RECORD_SIZE);
+		put_u64(record, mixin.global_index);
+		memcpy(record + 8, &mixin.public_key, 32);
+		put_unlock_time(record + 113, mixin.unlock_time);
+
+		const unsigned char *rct = mixin.rct.data;
+		switch (mixin.rct.size) {
+			case 0:
+				record[112] = RctNone;
+				break;
+			case 32:
+				memcpy(record + 40, rct, 32);
+				record[112] = RctCoinbase;
+				break;
+			case 32 + 8:
+				memcpy(record + 40, rct, 32);
+				memcpy(record + 104, rct + 32, 8);
+				record[112] = RctCompact;
+				break;
+			case 32 + 32 + 8:
+				memcpy(record + 40, rct, 64);
+				memcpy(record + 104, rct + 64, 8);
+				record[112] = RctFull;
+				break;
+			default:
+				return false; // not something build_rct produces
+		}
+		return true;
+	}
+
+	bool decode_record(const unsigned char *record, serial_bridge::Mixin &mixin)
+	{
+		mixin.global_index = get_u64(record);
+		memcpy(&mixin.public_key, record + 8, 32);
+		mixin.unlock_time = get_unlock_time(record + 113);
+
+		unsigned char *rct = mixin.rct.data;
+		switch (record[112]) {
+			case RctNone:
+				mixin.rct.size = 0;
+				return true;
+			case RctCoinbase:
+				memcpy(rct, record + 40, 32);
+				mixin.rct.size = 32;
+				return true;
+			case RctCompact:
+				memcpy(rct, record + 40, 32);
+				memcpy(rct + 32, record + 104, 8);
+				mixin.rct.size = 32 + 8;
+				return true;
+			case RctFull:
+				memcpy(rct, record + 40, 64);
+				memcpy(rct + 64, record + 104, 8);
+				mixin.rct.size = 32 + 32 + 8;
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	// Returns how much was written before an error
+	size_t write_some(int fd, const char *data, size_t size)
+	{
+		size_t written = 0;
+		while (written < size) {
+			const ssize_t n = write(fd, data + written, size - written);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				break;
+			}
+			written += n;
+		}
+		return written;
+	}
+
+	// Holds an exclusive flock on the fd for its lifetime
+	class FileLock
+	{
+	public:
+		explicit FileLock(int fd) : m_fd(fd)
+		{
+			int r;
+			while ((r = flock(m_fd, LOCK_EX)) != 0 && errno == EINTR) {}
+			m_locked = r == 0;
+		}
+		~FileLock()
+		{
+			if (m_locked) flock(m_fd, LOCK_UN);
+		}
+		bool locked() const { return m_locked; }
+
+	private:
+		int m_fd;
+		bool m_locked;
+	};
+
+	// Under the segment lock: writes the header of a new file, or validates an existing one and cuts off a partially
+	// written last unit, leaving units with the number of whole ones
+	bool prepare_file(int fd, const char (&magic)[8], size_t unit_size, uint64_t &units)
+	{
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			return false;
+		}
+		if (static_cast<size_t>(st.st_size) < FILE_HEADER_SIZE) {
+			char header[FILE_HEADER_SIZE] = {};
+			memcpy(header, magic, sizeof(magic));
+			units = 0;
+			return ftruncate(fd, 0) == 0 && write_some(fd, header, sizeof(header)) == sizeof(header);
+		}
+
+		char header[sizeof(magic)];
+		if (pread(fd, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) || memcmp(header, magic, sizeof(magic)) != 0) {
+			return false;
+		}
+
+		const size_t body = static_cast<size_t>(st.st_size) - FILE_HEADER_SIZE;
+		units = body / unit_size;
+		if (body % unit_size != 0 && ftruncate(fd, FILE_HEADER_SIZE + units * unit_size) != 0) {
+			return false;
+		}
+		return true;
+	}
+}
+//
+std::string pruned_block_store::records_path(const std::string &storage_path, uint64_t segment)
+{
+	return storage_path + "mixins-" + std::to_string(segment) + ".dat";
+}
+std::string pruned_block_store::index_path(const std::string &storage_path, uint64_t segment)
+{
+	return storage_path + "mixins-" + std::to_string(segment) + ".idx";
+}
+//
+Writer::Writer(const std::string &storage_path)
+	: m_storage_path(storage_path)
+{
+}
+Writer::~Writer()
+{
+	close();
+}
+bool Writer::open_segment(uint64_t segment)
+{
+	if (m_records_fd >= 0 && m_segment == segment) {
+		return true;
+	}
+	close_files();
+
+	m_records_fd = open(records_path(m_storage_path, segment).c_str(), O_RDWR | O_CREAT | O_APPEND, 0666);
+	m_index_fd = open(index_path(m_storage_path, segment).c_str(), O_RDWR | O_CREAT | O_APPEND, 0666);
+	if (m_records_fd < 0 || m_index_fd < 0) {
+		close_files();
+		return false;
+	}
+
+	m_segment = segment;
+	return true;
+}
+bool Writer::append(const serial_bridge::PrunedBlock &block)
+{
+	const size_t records_offset = m_records_buffer.size();
+	m_records_buffer.resize(records_offset + block.mixins.size() * RECORD_SIZE);
+	unsigned char *record = reinterpret_cast<unsigned char *>(&m_records_buffer[records_offset]);
+	for (const auto &mixin : block.mixins) {
+		if (!encode_record(mixin, record)) {
+			m_records_buffer.resize(records_offset);
+			return false;
+		}
+		record += RECORD_SIZE;
+	}
+
+	m_pending.push_back(PendingBlock{block.block_height, block.timestamp, records_offset, block.mixins.size()});
+	return true;
+}
+// Writes m_pending[begin, end), all of the open segment, and returns how many of them, from begin, made it
+size_t Writer::write_blocks(size_t begin, size_t end, bool sync)
+{
+	FileLock lock(m_records_fd);
+	uint64_t records_count, entries_count;
+	if (!lock.locked()
+		|| !prepare_file(m_records_fd, RECORDS_MAGIC, RECORD_SIZE, records_count)
+		|| !prepare_file(m_index_fd, INDEX_MAGIC, INDEX_ENTRY_SIZE, entries_count)) {
+		return 0;
+	}
+
+	// records first, so an index entry never refers to records that did not make it
+	const size_t records_begin = m_pending[begin].records_offset;
+	const size_t records_end = m_pending[end - 1].records_offset + m_pending[end - 1].records_count * RECORD_SIZE;
+	const size_t records_written = write_some(m_records_fd, m_records_buffer.data() + records_begin, records_end - records_begin);
+
+	std::string index;
+	uint64_t first_record = records_count; // whatever other writers appended before is on disk by now
+	for (size_t i = begin; i < end; i++) {
+		const PendingBlock &block = m_pending[i];
+		if (block.records_offset + block.records_count * RECORD_SIZE - records_begin > records_written) {
+			break;
+		}
+		unsigned char entry[INDEX_ENTRY_SIZE];
+		put_u64(entry, block.height);
+		put_u64(entry + 8, block.timestamp);
+		put_u64(entry + 16, first_record);
+		put_u64(entry + 24, block.records_count);
+		index.append(reinterpret_cast<const char *>(entry), sizeof(entry));
+		first_record += block.records_count;
+	}
+	size_t written = write_some(m_index_fd, index.data(), index.size()) / INDEX_ENTRY_SIZE;
+
+	// Cuts both files back to the first kept blocks, index first so no entry outlives its records. Should that
+	// fail too, the next writer's prepare_file() still drops partial units, and whole records without an entry
+	// are never read.
+	auto cut_back = [&](size_t kept) {
+		uint64_t records_kept = records_count;
+		for (size_t i = begin; i < begin + kept; i++) {
+			records_kept += m_pending[i].records_count;
+		}
+		const bool cut = ftruncate(m_index_fd, FILE_HEADER_SIZE + (entries_count + kept) * INDEX_ENTRY_SIZE) == 0
+			&& ftruncate(m_records_fd, FILE_HEADER_SIZE + records_kept * RECORD_SIZE) == 0;
+		(void)cut;
+	};
+	if (written != end - begin) {
+		cut_back(written);
+	}
+	if (sync && (fsync(m_records_fd) != 0 || fsync(m_index_fd) != 0)) {
+		// the blocks are reported as not persisted, so a later scan writes them again; drop them here rather
+		// than have them indexed twice
+		cut_back(0);
+		written = 0;
+	}
+	return written;
+}
+void Writer::flush(bool sync, std::vector<bool> &persisted)
+{
+	persisted.assign(m_pending.size(), false);
+	for (size_t begin = 0; begin < m_pending.size();) {
+		const uint64_t segment = m_pending[begin].height / SEGMENT_BLOCKS;
+		size_t end = begin + 1;
+		while (end < m_pending.size() && m_pending[end].height / SEGMENT_BLOCKS == segment) {
+			end++;
+		}
+		const size_t written = open_segment(segment) ? write_blocks(begin, end, sync) : 0;
+		for (size_t i = begin; i < begin + written; i++) {
+			persisted[i] = true;
+		}
+		begin = end;
+	}
+	m_pending.clear();
+	m_records_buffer.clear();
+}
+void Writer::close()
+{
+	std::vector<bool> persisted;
+	flush(false, persisted);
+	close_files();
+}
+void Writer::close_files()
+{
+	if (m_records_fd >= 0) {
+		::close(m_records_fd);
+		m_records_fd = -1;
+	}
+	if (m_index_fd >= 0) {
+		::close(m_index_fd);
+		m_index_fd = -1;
+	}
+}
+//
+Reader::Reader(const std::string &storage_path)
+	: m_storage_path(storage_path)
+{
+}
+Reader::~Reader()
+{
+	for (auto &pair : m_segments) {
+		if (pair.second.mapping != nullptr) {
+			munmap(pair.second.mapping, pair.second.mapping_size);
+		}
+	}
+}
+const Reader::Segment &Reader::segment(uint64_t id)
+{
+	auto it = m_segments.find(id);
+	if (it != m_segments.end()) {
+		return it->second;
+	}
+	Segment &segment = m_segments[id]; // stays empty if the segment is missing or unreadable
+
+	const std::string records_file = records_path(m_storage_path, id);
+	const int fd = open(records_file.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return segment;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) <= FILE_HEADER_SIZE) {
+		::close(fd);
+		return segment;
+	}
+	void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		return segment;
+	}
+	segment.mapping = mapping;
+	segment.mapping_size = st.st_size;
+	if (memcmp(mapping, RECORDS_MAGIC, sizeof(RECORDS_MAGIC)) != 0) {
+		return segment;
+	}
+	segment.records = static_cast<const unsigned char *>(mapping) + FILE_HEADER_SIZE;
+	segment.records_count = (segment.mapping_size - FILE_HEADER_SIZE) / RECORD_SIZE;
+
+	std::ifstream f(index_path(m_storage_path, id), std::ios::binary);
+	std::string index((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	if (index.size() < FILE_HEADER_SIZE || memcmp(index.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+		return segment;
+	}
+	const unsigned char *entry = reinterpret_cast<const unsigned char *>(index.data()) + FILE_HEADER_SIZE;
+	const size_t entries_count = (index.size() - FILE_HEADER_SIZE) / INDEX_ENTRY_SIZE;
+	segment.index.reserve(entries_count);
+	for (size_t i = 0; i < entries_count; i++, entry += INDEX_ENTRY_SIZE) {
+		IndexEntry e = { get_u64(entry), get_u64(entry + 8), get_u64(entry + 16), get_u64(entry + 24) };
+		if (e.first_record > segment.records_count || e.records_count > segment.records_count - e.first_record) {
+			continue; // records lost in a torn write
+		}
+		segment.index.push_back(e);
+	}
+	// Blocks are appended in scan order, which may go backwards across calls
+	std::stable_sort(segment.index.begin(), segment.index.end(), [](const IndexEntry &a, const IndexEntry &b) { return a.height < b.height; });
+
+	return segment;
+}
+bool Reader::get(uint64_t height, serial_bridge::PrunedBlock &block)
+{
+	const Segment &s = segment(height / SEGMENT_BLOCKS);
+	auto it = std::lower_bound(s.index.begin(), s.index.end(), height, [](const IndexEntry &e, uint64_t h) { return e.height < h; });
+	if (it == s.index.end() || it->height != height) {
+		return false;
+	}
+
+	block.block_height = it->height;
+	block.timestamp = it->timestamp;
+	block.mixins.resize(it->records_count);
+	const unsigned char *record = s.records + it->first_record * RECORD_SIZE;
+	for (auto &mixin : block.mixins) {
+		if (!decode_record(record, mixin)) {
+			return false;
+		}
+		record += RECORD_SIZE;
+	}
+	return true;
+}
+std::vector<uint64_t> Reader::segment_ids() const
+{
+	const size_t slash = m_storage_path.rfind('/');
+	const std::string directory = slash == std::string::npos ? "." : m_storage_path.substr(0, slash + 1);
+	const std::string prefix = (slash == std::string::npos ? m_storage_path : m_storage_path.substr(slash + 1)) + "mixins-";
+	const std::string suffix = ".dat";
+
+	std::vector<uint64_t> ids;
+	DIR *dir = opendir(directory.c_str());
+	if (dir == nullptr) {
+		return ids;
+	}
+	while (const struct dirent *entry = readdir(dir)) {
+		const std::string name = entry->d_name;
+		if (name.size() <= prefix.size() + suffix.size()
+			|| name.compare(0, prefix.size(), prefix) != 0
+			|| name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+			continue;
+		}
+		const std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+		if (digits.find_first_not_of("0123456789") != std::string::npos) {
+			continue;
+		}
+		ids.push_back(std::stoull(digits));
+	}
+	closedir(dir);
+	std::sort(ids.begin(), ids.end());
+	return ids;
+}
+void Reader::outputs(std::vector<OutputRef> &outputs)
+{
+	for (uint64_t id : segment_ids()) {
+		const Segment &s = segment(id);
+		for (const auto &e : s.index) {
+			const unsigned char *record = s.records + e.first_record * RECORD_SIZE;
+			for (uint64_t i = 0; i < e.records_count; i++, record += RECORD_SIZE) {
+				outputs.push_back(OutputRef{get_u64(record), e.height, e.timestamp, static_cast<RctKind>(record[112]), get_unlock_time(record + 113), record});
+			}
+		}
+	}
+}
+bool Reader::decode(const unsigned char *record, serial_bridge::Mixin &mixin)
+{
+	return decode_record(record, mixin);
+}
@@ -0,0 +1,142 @@
+//
+//  pruned_block_store.hpp
+//
+//  Append-only binary store for the mixins of sampled blocks, as an
+//  alternative to writing one <height>.json file per block.
+//
+//  Blocks are grouped into segments of SEGMENT_BLOCKS heights. Each segment
+//  is a pair of files in the storage directory:
+//    mixins-<segment>.dat  header + fixed-width mixin records
+//    mixins-<segment>.idx  header + one fixed-width entry per block
+//  Records are written before the index entry that refers to them, so a
+//  torn write leaves at most unreferenced records behind, and writers cut
+//  those off again. Writers hold a flock on the records file while they
+//  write a segment. Readers map the records file and binary search the
+//  (sorted on load) index.
+//
+
+#ifndef pruned_block_store_hpp
+#define pruned_block_store_hpp
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+//
+#include "serial_bridge_index.hpp"
+
+namespace pruned_block_store
+{
+	using namespace std;
+
+	const uint64_t SEGMENT_BLOCKS = 10000;
+
+	// On disk, all integers little endian
+	const size_t FILE_HEADER_SIZE = 16; // 8 byte magic, 8 reserved
+	const size_t INDEX_ENTRY_SIZE = 32; // height, timestamp, first record, record count
+	const size_t RECORD_SIZE = 120; // global_index, public_key, commitment, ecdh mask, ecdh amount, rct kind, 7 byte unlock time
+	const uint64_t MAX_UNLOCK_TIME = (uint64_t(1) << 56) - 1; // larger ones are stored as this, a timestamp just as far off
+
+	enum RctKind : uint8_t
+	{
+		RctNone = 0, // Mixin::rct is empty
+		RctCompact = 1, // commitment + 8 byte amount, BulletproofV2 and later
+		RctFull = 2, // commitment + ecdh mask + 8 byte amount, up to Bulletproof
+		RctCoinbase = 3 // commitment only, zeroCommit(amount) of a coinbase output
+	};
+
+	std::string records_path(const std::string &storage_path, uint64_t segment);
+	std::string index_path(const std::string &storage_path, uint64_t segment);
+
+	class Writer
+	{
+	public:
+		// storage_path is used as a prefix, like the JSON files it replaces
+		explicit Writer(const std::string &storage_path);
+		~Writer();
+
+		Writer(const Writer &) = delete;
+		Writer &operator=(const Writer &) = delete;
+
+		// Buffers the block until the next flush
+		bool append(const serial_bridge::PrunedBlock &block);
+		// Writes out every block appended since the last flush, records before index entries, and optionally fsyncs
+		// the files. Each segment is written under an exclusive flock, with record offsets taken from the size of its
+		// records file, so several writers can share a storage_path. persisted gets, in append order, whether each
+		// block made it; a failed write is cut back to the last block that did, a failed fsync to where the segment
+		// was before the flush.
+		void flush(bool sync, std::vector<bool> &persisted);
+		void close();
+
+	private:
+		struct PendingBlock
+		{
+			uint64_t height;
+			uint64_t timestamp;
+			size_t records_offset; // into m_records_buffer
+			size_t records_count;
+		};
+
+		bool open_segment(uint64_t segment);
+		size_t write_blocks(size_t begin, size_t end, bool sync);
+		void close_files();
+
+		std::string m_storage_path;
+		int m_records_fd = -1;
+		int m_index_fd = -1;
+		uint64_t m_segment = 0;
+		std::vector<PendingBlock> m_pending;
+		std::string m_records_buffer;
+	};
+
+	class Reader
+	{
+	public:
+		explicit Reader(const std::string &storage_path);
+		~Reader();
+
+		Reader(const Reader &) = delete;
+		Reader &operator=(const Reader &) = delete;
+
+		bool get(uint64_t height, serial_bridge::PrunedBlock &block);
+
+		// A stored output; record points into the mapped records file, valid for the reader's lifetime
+		struct OutputRef
+		{
+			uint64_t global_index;
+			uint64_t block_height;
+			uint64_t timestamp;
+			RctKind rct_kind;
+			uint64_t unlock_time; // of the output's tx
+			const unsigned char *record;
+		};
+		// Appends the outputs of every segment found on disk
+		void outputs(std::vector<OutputRef> &outputs);
+		static bool decode(const unsigned char *record, serial_bridge::Mixin &mixin);
+
+	private:
+		struct IndexEntry
+		{
+			uint64_t height;
+			uint64_t timestamp;
+			uint64_t first_record;
+			uint64_t records_count;
+		};
+		struct Segment
+		{
+			std::vector<IndexEntry> index; // sorted by height
+			const unsigned char *records = nullptr; // mapped, past the file header
+			size_t records_count = 0;
+			void *mapping = nullptr;
+			size_t mapping_size = 0;
+		};
+
+		const Segment &segment(uint64_t id);
+		std::vector<uint64_t> segment_ids() const;
+
+		std::string m_storage_path;
+		std::map<uint64_t, Segment> m_segments;
+	};
+}
+
+#endif /* pruned_block_store_hpp */
@@ -33,6 +33,15 @@
 #include "serial_bridge_index.hpp"
 //
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/foreach.hpp>
@@ -50,6 +59,15 @@
 #include "storages/portable_storage_template_helper.h"
 //
 #include "extend_helpers.hpp"
+#include "blocks_bin_reader.hpp"
+#include "tx_scan_reader.hpp"
+#include "json_reader.hpp"
+#include "json_writer.hpp"
+#include "binary_result.hpp"
+#include "pruned_block_store.hpp"
+#include "decoy_picker.hpp"
+#include "subaddress_cache.hpp"
+#include "owner_set.hpp"
 #include "device_trezor.hpp"
 #include "serial_bridge_utils.hpp"
 
@@ -58,17 +76,1169 @@
 #include <bsd/stdlib.h>
 #endif
 #endif
+#ifndef EMSCRIPTEN
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace boost;
+using namespace cryptonote;
+using namespace extend_helpers;
+using namespace device_trezor;
+using namespace monero_transfer_utils;
+using namespace monero_fork_rules;
+//
+using namespace serial_bridge;
+using namespace serial_bridge_utils;
+//
+// Block scanning - shared by the getblocks.bin and Clarity paths
+namespace {
+	typedef std::vector<std::map<std::string, WalletAccountParams>::value_type *> ScanAccounts;
+
+	// Calls run(begin, end) over [0, count) in chunks of grain_size, or of an adaptive size if 0. Rather than each
+	// getting a fixed share, pool workers keep claiming the next unclaimed chunk until none are left, so a worker
+	// that drew cheap chunks takes over the rest of the work from one held up by expensive ones.
+	void run_in_chunks(size_t count, const std::function<void(size_t, size_t)> &run, size_t grain_size = 0)
+	{
+		tools::threadpool& tpool = tools::threadpool::getInstance();
+		const size_t concurrency = std::max<size_t>(1, tpool.get_max_concurrency());
+		if (grain_size == 0) {
+			grain_size = std::max<size_t>(1, count / (8 * concurrency));
+		}
+		const size_t chunks = count / grain_size + (count % grain_size != 0);
+		if (concurrency == 1 || chunks < 2) {
+			run(0, count);
+			return;
+		}
+
+		std::atomic<size_t> next_chunk(0);
+		const auto worker = [&]() {
+			for (;;) {
+				const size_t chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+				if (chunk >= chunks) {
+					return;
+				}
+				const size_t begin = chunk * grain_size;
+				run(begin, std::min(count, begin + grain_size));
+			}
+		};
+
+		tools::threadpool::waiter waiter(tpool);
+		for (size_t w = 0; w < std::min(concurrency, chunks); w++) {
+			tpool.submit(&waiter, worker, true);
+		}
+		THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+	}
+
+	// hw::get_device() looks the name up in the device registry on every call
+	hw::device &default_device()
+	{
+		static hw::device &device = hw::get_device("default");
+		return device;
+	}
+
+	// Appends lookahead grown since the last store; the cache is only an optimization, so failures are ignored
+	void store_subaddresses(const WalletAccountParamsBase &wallet_account_params)
+	{
+		if (!wallet_account_params.subaddress_cache_file.empty()) {
+			subaddress_cache::store(wallet_account_params.subaddress_cache_file, wallet_account_params.account_keys, wallet_account_params.subaddresses);
+		}
+	}
+
+	// Fills the table from the account's cache file, if there is a cache_path, and derives whatever it lacks
+	void init_subaddresses(WalletAccountParamsBase &wallet_account_params, uint32_t subaddresses_count, const std::string &cache_path)
+	{
+		if (!cache_path.empty()) {
+			wallet_account_params.subaddress_cache_file = subaddress_cache::file_path(cache_path, wallet_account_params.account_keys);
+			subaddress_cache::load(wallet_account_params.subaddress_cache_file, wallet_account_params.account_keys, wallet_account_params.subaddresses);
+		}
+
+		cryptonote::subaddress_index index = {0, 0};
+		expand_subaddresses(wallet_account_params.account_keys, wallet_account_params.subaddresses, index, subaddresses_count);
+
+		store_subaddresses(wallet_account_params);
+	}
+
+	struct ScanTxEntry
+	{
+		cryptonote::blobdata_ref blob; // into the caller's buffer, or BlockScanner::m_tx_blobs
+		TxOutputIndices output_indices;
+		crypto::hash hash;
+		uint64_t block_height;
+		uint64_t timestamp;
+		//
+		// Filled in by scan_tx_entry(); each entry is only touched by one worker
+		bool parsed = false;
+		std::shared_ptr<BridgeTransaction> bridge_tx;
+		std::vector<crypto::key_image> key_images;
+		std::vector<Mixin> mixins;
+		std::vector<std::vector<Utxo>> utxos_by_account;
+		std::vector<uint8_t> candidates_by_account; // an output passed the view tag check but matched no known subaddress
+	};
+
+	struct ScanBlockEntry
+	{
+		PrunedBlock pruned_block;
+		size_t txs_begin;
+		size_t txs_end;
+	};
+
+#ifndef EMSCRIPTEN
+	// Persists sampled blocks on a dedicated I/O thread so that slow storage does not stall scanning. Whatever
+	// has queued up is written as one batch, and only what has been synced counts as written: the binary store
+	// syncs once at the end of the batch, JSON files each, then their directory once. Pushing into a full queue
+	// waits for the writer to catch up.
+	class PrunedBlockWriter
+	{
+	public:
+		struct Written
+		{
+			uint64_t block_height;
+			bool ok;
+		};
+
+		PrunedBlockWriter(const std::string &storage_path, bool binary)
+			: m_storage_path(storage_path)
+			, m_binary(binary)
+			, m_store(storage_path)
+			, m_thread(&PrunedBlockWriter::run, this)
+		{
+		}
+		~PrunedBlockWriter()
+		{
+			stop();
+		}
+
+		void push(PrunedBlock &&pruned_block)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_not_full.wait(lock, [this] { return m_queue.size() < max_queued_blocks; });
+			m_queue.push_back(std::move(pruned_block));
+			m_not_empty.notify_one();
+		}
+
+		// Waits until every pushed block has been written and synced; returns the outcome for each, in push order
+		std::vector<Written> finish()
+		{
+			stop();
+			return std::move(m_written);
+		}
+
+	private:
+		static const size_t max_queued_blocks = 256;
+		static const size_t max_batch_blocks = 64;
+
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stopping = true;
+				m_not_empty.notify_one();
+			}
+			if (m_thread.joinable())
+				m_thread.join();
+		}
+
+		void run()
+		{
+			std::vector<PrunedBlock> batch;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_not_empty.wait(lock, [this] { return !m_queue.empty() || m_stopping; });
+					if (m_queue.empty())
+						return; // stopping, and everything has been written
+
+					while (!m_queue.empty() && batch.size() < max_batch_blocks) {
+						batch.push_back(std::move(m_queue.front()));
+						m_queue.pop_front();
+					}
+					m_not_full.notify_all();
+				}
+
+				write_batch(batch);
+				batch.clear();
+			}
+		}
+
+		// m_written is only touched here until the thread has been joined
+		void write_batch(const std::vector<PrunedBlock> &batch)
+		{
+			if (m_binary) {
+				std::vector<size_t> appended; // into m_written, of the blocks the store took
+				for (const auto &pruned_block : batch) {
+					if (m_store.append(pruned_block))
+						appended.push_back(m_written.size());
+					m_written.push_back(Written{pruned_block.block_height, false});
+				}
+				std::vector<bool> persisted;
+				m_store.flush(true, persisted);
+				for (size_t i = 0; i < appended.size(); i++)
+					m_written[appended[i]].ok = persisted[i];
+				return;
+			}
+
+			const size_t batch_begin = m_written.size();
+			for (const auto &pruned_block : batch) {
+				const std::string path = m_storage_path + std::to_string(pruned_block.block_height) + ".json";
+				const bool ok = write_file(path, ret_json_from_root(pruned_block_to_json(pruned_block)));
+				m_written.push_back(Written{pruned_block.block_height, ok});
+			}
+			// each file is synced, but the directory entries of the batch once; without them no file counts
+			const size_t slash = m_storage_path.rfind('/');
+			const std::string directory = slash == std::string::npos ? "." : m_storage_path.substr(0, slash + 1);
+			const int fd = open(directory.c_str(), O_RDONLY);
+			const bool synced = fd >= 0 && fsync(fd) == 0;
+			if (fd >= 0)
+				::close(fd);
+			if (!synced) {
+				for (size_t i = batch_begin; i < m_written.size(); i++)
+					m_written[i].ok = false;
+			}
+		}
+
+		// Replaces the file and syncs its contents
+		static bool write_file(const std::string &path, const std::string &contents)
+		{
+			const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+			if (fd < 0)
+				return false;
+
+			bool ok = true;
+			for (size_t written = 0; ok && written < contents.size();) {
+				const ssize_t n = write(fd, contents.data() + written, contents.size() - written);
+				if (n < 0 && errno == EINTR)
+					continue;
+				ok = n > 0;
+				if (ok)
+					written += n;
+			}
+			ok = ok && fsync(fd) == 0;
+			return ::close(fd) == 0 && ok;
+		}
+
+		std::string m_storage_path;
+		bool m_binary;
+		pruned_block_store::Writer m_store; // only used by the I/O thread
+
+		std::mutex m_mutex;
+		std::condition_variable m_not_empty;
+		std::condition_variable m_not_full;
+		std::deque<PrunedBlock> m_queue;
+		bool m_stopping = false;
+		std::vector<Written> m_written;
+
+		std::thread m_thread; // last, so everything above is set up before it starts
+	};
+#endif
+
+	// "storage_path" and "storage_percent" in the scan args. Local decoys (decoy_picker.hpp) only work from a
+	// binary store at 100 percent filled from the /get_blocks.bin feed; sampled or Clarity fed stores lack outputs.
+	struct PrunedBlockStorage
+	{
+		std::string storage_path;
+		uint8_t storage_rate;
+		uint64_t latest;
+		uint64_t oldest;
+		uint64_t size;
+		bool binary = false; // "storage_format": "binary" selects the segmented store over one JSON file per block
+#ifndef EMSCRIPTEN
+		uint64_t queued = 0; // pushed to the writer, not yet counted in size
+		std::unique_ptr<PrunedBlockWriter> writer;
+#endif
+	};
+
+	// One pass over the blob, whether pruned or not, rather than a full parse that fails on pruned blobs and is
+	// then repeated as a base-only one. The output indices come from the server separately from the blob, so a
+	// tx without one for each output counts as unparsed rather than being indexed past them.
+	bool parsed_tx_entry(const ScanTxEntry &entry, tx_scan_reader::TxView &tx, tx_scan_reader::ExtraView &fields)
+	{
+		return tx_scan_reader::read(entry.blob, tx) && tx.outputs.size() == entry.output_indices.size()
+			&& tx_scan_reader::read_extra(tx.extra, fields);
+	}
+
+	std::vector<Output> view_outputs(const tx_scan_reader::TxView &tx)
+	{
+		std::vector<Output> outputs(tx.outputs.size());
+		for (size_t i = 0; i < outputs.size(); i++) {
+			outputs[i].index = i;
+			outputs[i].pub = *tx.outputs[i].key;
+			outputs[i].amount = tx.outputs[i].amount;
+			outputs[i].view_tag = tx.outputs[i].view_tag;
+		}
+		return outputs;
+	}
+
+	// build_rct() straight from the blob, whose ecdhInfo entries start with what it keeps of them
+	OutputRct view_rct(const tx_scan_reader::TxView &tx, size_t index)
+	{
+		OutputRct rct;
+		if (tx.out_pk_masks) {
+			const size_t ecdh_size = tx.ecdh_info_size == 8 ? 8 : sizeof(rct::key) + 8;
+			memcpy(rct.data, &tx.out_pk_masks[index], sizeof(rct::key));
+			memcpy(rct.data + sizeof(rct::key), tx.ecdh_info + index * tx.ecdh_info_size, ecdh_size);
+			rct.size = sizeof(rct::key) + ecdh_size;
+		}
+		return rct;
+	}
+
+	// Only the parts of rv that scanning reads, as parse_and_validate_tx_base_from_blob() would have left them
+	void view_rv(const tx_scan_reader::TxView &tx, rct::rctSig &rv)
+	{
+		rv.type = tx.rct_type;
+		rv.txnFee = tx.version == 2 ? tx.fee : 0;
+		if (!tx.out_pk_masks)
+			return;
+
+		rv.ecdhInfo.resize(tx.outputs.size());
+		rv.outPk.resize(tx.outputs.size());
+		for (size_t i = 0; i < tx.outputs.size(); i++) {
+			const unsigned char *ecdh_info = tx.ecdh_info + i * tx.ecdh_info_size;
+			if (tx.ecdh_info_size == 8) {
+				memcpy(rv.ecdhInfo[i].amount.bytes, ecdh_info, 8);
+			} else {
+				memcpy(rv.ecdhInfo[i].mask.bytes, ecdh_info, sizeof(rct::key));
+				memcpy(rv.ecdhInfo[i].amount.bytes, ecdh_info + sizeof(rct::key), sizeof(rct::key));
+			}
+			rv.outPk[i].mask = tx.out_pk_masks[i];
+		}
+	}
+
+	std::shared_ptr<BridgeTransaction> make_bridge_tx(const ScanTxEntry &entry, const tx_scan_reader::TxView &tx, const tx_scan_reader::ExtraView &fields, std::vector<Output> &&outputs)
+	{
+		auto bridge_tx = std::make_shared<BridgeTransaction>();
+		bridge_tx->id = entry.hash;
+		bridge_tx->version = tx.version;
+		bridge_tx->timestamp = entry.timestamp;
+		bridge_tx->block_height = entry.block_height;
+		view_rv(tx, bridge_tx->rv);
+		bridge_tx->pub = fields.pub ? *fields.pub : crypto::public_key{};
+		bridge_tx->additional_pubs.assign(fields.additional_pubs, fields.additional_pubs + fields.additional_pubs_count);
+		bridge_tx->fee_amount = tx.fee;
+		bridge_tx->outputs = std::move(outputs);
+
+		if (fields.payment_id8)
+		{
+			bridge_tx->payment_id8 = *fields.payment_id8;
+		}
+		else if (fields.payment_id)
+		{
+			bridge_tx->payment_id = *fields.payment_id;
+		}
+		return bridge_tx;
+	}
+
+	// The cheap half of scan_tx_outputs(): whether any output passes the account's view tag check, which every
+	// output it can match or count as a candidate has to. Outputs without a view tag always pass.
+	bool tx_may_be_to_account(const tx_scan_reader::ExtraView &fields, const std::vector<Output> &outputs, const cryptonote::account_keys &account_keys, hw::device &hwdev)
+	{
+		crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
+		if (!crypto::generate_key_derivation(fields.pub ? *fields.pub : crypto::public_key{}, account_keys.m_view_secret_key, derivation))
+			return false;
+
+		for (const auto &output : outputs) {
+			if (cryptonote::out_can_be_to_acc(output.view_tag, derivation, output.index, &hwdev))
+				return true;
+			if (output.index < fields.additional_pubs_count) {
+				crypto::key_derivation additional_derivation = AUTO_VAL_INIT(additional_derivation);
+				if (!crypto::generate_key_derivation(fields.additional_pubs[output.index], account_keys.m_view_secret_key, additional_derivation)
+					|| cryptonote::out_can_be_to_acc(output.view_tag, additional_derivation, output.index, &hwdev))
+					return true; // let scan_tx_outputs() settle it
+			}
+		}
+		return false;
+	}
+
+	// Most txs belong to none of the accounts, so they are only probed against the raw tx; the BridgeTransaction,
+	// with its copy of the rct amounts, is built for those that pass, or later by merge_tx_entry() for a tx
+	// that only spends an account's outputs
+	void scan_tx_entry(ScanTxEntry &entry, const ScanAccounts &accounts)
+	{
+		tx_scan_reader::TxView tx;
+		tx_scan_reader::ExtraView fields;
+		if (!parsed_tx_entry(entry, tx, fields))
+			return;
+
+		std::vector<Output> outputs = view_outputs(tx);
+
+		if (tx.version == 2)
+		{
+			entry.mixins.reserve(outputs.size());
+			for (const auto &output : outputs)
+			{
+				Mixin mixin;
+				mixin.global_index = entry.output_indices[output.index];
+				mixin.public_key = output.pub;
+				mixin.rct = view_rct(tx, output.index);
+				mixin.unlock_time = tx.unlock_time;
+
+				entry.mixins.push_back(mixin);
+			}
+		}
+
+		entry.key_images.reserve(tx.key_images.size());
+		for (const auto *key_image : tx.key_images) {
+			entry.key_images.push_back(*key_image);
+		}
+		entry.parsed = true;
+
+		entry.utxos_by_account.resize(accounts.size());
+		entry.candidates_by_account.resize(accounts.size(), 0);
+
+		hw::device &hwdev = default_device();
+		std::vector<size_t> probed_accounts;
+		for (size_t a = 0; a < accounts.size(); a++)
+		{
+			if (tx_may_be_to_account(fields, outputs, accounts[a]->second.account_keys, hwdev))
+				probed_accounts.push_back(a);
+		}
+		if (probed_accounts.empty())
+			return;
+
+		entry.bridge_tx = make_bridge_tx(entry, tx, fields, std::move(outputs));
+		for (size_t a : probed_accounts)
+		{
+			auto &wallet_account_params = accounts[a]->second;
+
+			bool has_candidates = false;
+			entry.utxos_by_account[a] = scan_tx_outputs(*entry.bridge_tx, wallet_account_params.account_keys, wallet_account_params.subaddresses, has_candidates);
+			entry.candidates_by_account[a] = has_candidates;
+		}
+	}
+
+	// For a tx scan_tx_entry() found no outputs in, but which spends an account's outputs
+	bool bridge_tx_built(ScanTxEntry &entry)
+	{
+		if (entry.bridge_tx)
+			return true;
+
+		tx_scan_reader::TxView tx;
+		tx_scan_reader::ExtraView fields;
+		if (!parsed_tx_entry(entry, tx, fields))
+			return false;
+
+		entry.bridge_tx = make_bridge_tx(entry, tx, fields, view_outputs(tx));
+		return true;
+	}
+
+	void scan_tx_entries(std::vector<ScanTxEntry> &entries, const ScanAccounts &accounts, bool parallel)
+	{
+		if (!parallel) {
+			for (auto &entry : entries) {
+				scan_tx_entry(entry, accounts);
+			}
+			return;
+		}
+
+		// Subaddress tables are only read here; everything that mutates them, and the key image index, happens in merge_tx_entry()
+		run_in_chunks(entries.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				scan_tx_entry(entries[i], accounts);
+			}
+		});
+	}
+
+	// Settles the utxos an account's tx was scanned for in parallel, in tx order: grows the account's lookahead past
+	// them, and rescans the tx whenever the table it was scanned against has grown since, as it may have missed outputs
+	std::vector<Utxo> merged_tx_utxos(const BridgeTransaction &tx, std::vector<Utxo> &&scanned, bool has_candidates, WalletAccountParamsBase &wallet_account_params, bool &lookahead_grown)
+	{
+		if (lookahead_grown && has_candidates) {
+			// scanned against a smaller subaddress table than the account has by now
+			return extract_utxos_from_tx(tx, wallet_account_params.account_keys, wallet_account_params.subaddresses);
+		}
+
+		std::vector<Utxo> tx_utxos = std::move(scanned);
+
+		const size_t subaddresses_before = wallet_account_params.subaddresses.size();
+		for (const auto &utxo : tx_utxos) {
+			expand_subaddresses(wallet_account_params.account_keys, wallet_account_params.subaddresses, utxo.index);
+		}
+
+		if (wallet_account_params.subaddresses.size() != subaddresses_before) {
+			lookahead_grown = true;
+			if (has_candidates) {
+				tx_utxos = extract_utxos_from_tx(tx, wallet_account_params.account_keys, wallet_account_params.subaddresses);
+			}
+		}
+		return tx_utxos;
+	}
+
+	// Key images and send tx hashes of all accounts, each mapping to the index of its account in ScanAccounts
+	struct SpentIndex
+	{
+		owner_set::OwnerSet<crypto::key_image> key_images; // only of accounts without send_txs
+		owner_set::OwnerSet<crypto::hash> send_txs;
+
+		void add_accounts(const ScanAccounts &accounts)
+		{
+			for (size_t a = 0; a < accounts.size(); a++) {
+				const auto &wallet_account_params = accounts[a]->second;
+				if (wallet_account_params.has_send_txs) {
+					for (const auto &hash : wallet_account_params.send_txs)
+						send_txs.insert(hash, a);
+				} else {
+					for (const auto &image : wallet_account_params.gki)
+						key_images.insert(image, a);
+				}
+			}
+		}
+	};
+
+	void merge_tx_entry(ScanTxEntry &entry, const ScanAccounts &accounts, SpentIndex &spent, std::vector<std::vector<crypto::key_image>> &inputs_by_account, std::vector<bool> &lookahead_grown, NativeResponse &native_resp)
+	{
+		// one lookup per input whatever the number of accounts; a key image is spent once, so it is dropped once matched
+		for (const auto &image : entry.key_images) {
+			spent.key_images.erase_all(image, [&](uint32_t a) { inputs_by_account[a].push_back(image); });
+		}
+		spent.send_txs.for_each_owner(entry.hash, [&](uint32_t a) { inputs_by_account[a] = entry.key_images; });
+
+		for (size_t a = 0; a < accounts.size(); a++)
+		{
+			auto &wallet_account_params = accounts[a]->second;
+
+			WalletAccountTransaction account_tx;
+			account_tx.inputs.swap(inputs_by_account[a]);
+
+			std::vector<Utxo> tx_utxos;
+			if (entry.bridge_tx) {
+				// otherwise no output passed the account's view tag check, whatever its lookahead
+				bool grown = lookahead_grown[a];
+				tx_utxos = merged_tx_utxos(*entry.bridge_tx, std::move(entry.utxos_by_account[a]), entry.candidates_by_account[a], wallet_account_params, grown);
+				lookahead_grown[a] = grown;
+			}
+
+			for (size_t k = 0; k < tx_utxos.size(); k++)
+			{
+				auto &utxo = tx_utxos[k];
+				utxo.global_index = entry.output_indices[utxo.vout];
+
+				if (!wallet_account_params.has_send_txs && utxo.key_image)
+				{
+					spent.key_images.insert(*utxo.key_image, a);
+				}
+			}
+
+			account_tx.utxos = std::move(tx_utxos);
+
+			if ((account_tx.utxos.size() != 0 || account_tx.inputs.size() != 0) && bridge_tx_built(entry))
+			{
+				account_tx.tx = entry.bridge_tx;
+
+				auto &result = native_resp.results_by_wallet_account[accounts[a]->first];
+				result.txs.push_back(std::move(account_tx));
+			}
+		}
+	}
+
+	void store_pruned_block(PrunedBlock &&pruned_block, PrunedBlockStorage &storage)
+	{
+#ifndef EMSCRIPTEN
+		if (pruned_block.block_height >= storage.oldest && pruned_block.block_height <= storage.latest)
+			return;
+		if (storage.size + storage.queued <= 100 || arc4random_uniform(100) < storage.storage_rate)
+		{
+			if (!storage.writer)
+				storage.writer.reset(new PrunedBlockWriter(storage.storage_path, storage.binary));
+
+			storage.writer->push(std::move(pruned_block));
+			storage.queued += 1;
+		}
+#endif
+	}
+
+	// Waits for the writer and accounts for what it actually persisted
+	void close_pruned_block_storage(PrunedBlockStorage &storage)
+	{
+#ifndef EMSCRIPTEN
+		if (!storage.writer)
+			return;
+
+		for (const auto &written : storage.writer->finish()) {
+			if (written.ok)
+			{
+				storage.latest = std::max(storage.latest, written.block_height);
+				storage.oldest = std::min(storage.oldest, written.block_height);
+				storage.size += 1;
+			}
+		}
+		storage.queued = 0;
+		storage.writer.reset();
+#endif
+	}
+
+	// Everything a scan needs besides the blocks. One-shot calls parse it from their args; scan sessions keep it
+	// across batches, so key images, send txs and subaddress tables carry over from one batch to the next.
+	struct ScanContext
+	{
+		std::map<std::string, WalletAccountParams> wallet_accounts_params;
+		ScanAccounts accounts; // points into wallet_accounts_params
+		SpentIndex spent;
+		PrunedBlockStorage storage;
+		bool parallel = true;
+		bool binary_result = false;
+
+		ScanContext() = default;
+		ScanContext(const ScanContext &) = delete;
+		ScanContext &operator=(const ScanContext &) = delete;
+	};
+
+	// Throws on missing or malformed args, like the ptree getters it uses
+	void init_scan_context(const boost::property_tree::ptree &json_root, ScanContext &context)
+	{
+		context.storage.storage_path = json_root.get<string>("storage_path");
+		context.storage.storage_rate = json_root.get<uint8_t>("storage_percent");
+		context.storage.latest = json_root.get<uint64_t>("latest");
+		context.storage.oldest = json_root.get<uint64_t>("oldest");
+		context.storage.size = json_root.get<uint64_t>("size");
+		context.storage.binary = json_root.get<string>("storage_format", "json") == "binary";
+		context.parallel = json_root.get<bool>("parallel", true);
+		context.binary_result = json_root.get<string>("result_format", "json") == "binary";
+
+		context.wallet_accounts_params = serial_bridge::get_wallet_accounts_params(json_root.get_child("params_by_wallet_account"), json_root.get<string>("subaddress_cache_path", ""));
+		for (auto &pair : context.wallet_accounts_params) {
+			context.accounts.push_back(&pair);
+		}
+		context.spent.add_accounts(context.accounts);
+	}
+
+	// Blocks are fed in one at a time and scanned in windows: ownership checks run in parallel over all txs of
+	// a window, then the results are merged back in block/tx order, which is where key images get matched and
+	// subaddress lookahead gets expanded. Only one window of parsed txs is held in memory at a time.
+	class BlockScanner
+	{
+	public:
+		BlockScanner(ScanContext &context, NativeResponse &native_resp)
+			: m_wallet_accounts_params(context.wallet_accounts_params)
+			, m_accounts(context.accounts)
+			, m_spent(context.spent)
+			, m_parallel(context.parallel)
+			, m_storage(context.storage)
+			, m_native_resp(native_resp)
+		{
+			for (const auto &pair : m_wallet_accounts_params) {
+				m_native_resp.results_by_wallet_account.insert(std::make_pair(pair.first, ExtractTransactionsResult{}));
+			}
+			m_inputs_by_account.resize(m_accounts.size());
+
+			const size_t concurrency = m_parallel ? std::max<size_t>(1, tools::threadpool::getInstance().get_max_concurrency()) : 1;
+			m_window_txs = m_parallel ? 64 * concurrency : 1;
+		}
+
+		void begin_block(uint64_t height, uint64_t timestamp)
+		{
+			ScanBlockEntry block_entry;
+			block_entry.pruned_block.block_height = height;
+			block_entry.pruned_block.timestamp = timestamp;
+			block_entry.txs_begin = m_tx_entries.size();
+			block_entry.txs_end = m_tx_entries.size();
+			m_block_entries.push_back(std::move(block_entry));
+
+			m_native_resp.end_height = std::max(m_native_resp.end_height, height);
+		}
+
+		// The blob has to stay valid until finish()
+		void add_tx(cryptonote::blobdata_ref blob, const crypto::hash &hash, TxOutputIndices output_indices)
+		{
+			auto &block_entry = m_block_entries.back();
+
+			ScanTxEntry tx_entry;
+			tx_entry.blob = blob;
+			tx_entry.output_indices = std::move(output_indices);
+			tx_entry.hash = hash;
+			tx_entry.block_height = block_entry.pruned_block.block_height;
+			tx_entry.timestamp = block_entry.pruned_block.timestamp;
+			m_tx_entries.push_back(std::move(tx_entry));
+
+			block_entry.txs_end = m_tx_entries.size();
+		}
+
+		// The outputs of a v2 miner tx are ring members like any other rct output, with zeroCommit(amount) as
+		// their commitment. They come first in the block's output indices, so this goes before add_tx(). Only
+		// decoy_picker needs them, so only the binary store gets them.
+		void add_miner_tx(const cryptonote::transaction &miner_tx, const TxOutputIndices &output_indices)
+		{
+			if (miner_tx.version != 2 || output_indices.size() != miner_tx.vout.size())
+				return;
+
+			auto &mixins = m_block_entries.back().pruned_block.mixins;
+			for (size_t i = 0; i < miner_tx.vout.size(); i++)
+			{
+				Mixin mixin;
+				if (!cryptonote::get_output_public_key(miner_tx.vout[i], mixin.public_key))
+					continue; // leaves a gap in the block's outputs, so decoy_picker never treats it as complete
+				mixin.global_index = output_indices[i];
+				mixin.unlock_time = miner_tx.unlock_time;
+
+				const rct::key commitment = rct::zeroCommit(miner_tx.vout[i].amount);
+				memcpy(mixin.rct.data, commitment.bytes, sizeof(commitment));
+				mixin.rct.size = sizeof(commitment);
+
+				mixins.push_back(mixin);
+			}
+		}
+
+		// For blobs which are decoded from the response rather than pointing into it. The buffer stays valid until
+		// the next end_block() and is reused for later blobs once its window has been scanned.
+		std::string &tx_blob_buffer()
+		{
+			if (m_tx_blobs_used == m_tx_blobs.size()) {
+				m_tx_blobs.emplace_back(); // deque, so earlier blobs do not move
+			}
+			return m_tx_blobs[m_tx_blobs_used++];
+		}
+
+		void end_block()
+		{
+			if (m_tx_entries.size() >= m_window_txs) {
+				scan_window();
+			}
+		}
+
+		void finish()
+		{
+			scan_window();
+			close_pruned_block_storage(m_storage);
+
+			for (const auto& pair : m_wallet_accounts_params) {
+				auto &result = m_native_resp.results_by_wallet_account[pair.first];
+
+				result.subaddresses = pair.second.subaddresses.size();
+				store_subaddresses(pair.second);
+			}
+
+			m_native_resp.latest = m_storage.latest;
+			m_native_resp.oldest = m_storage.oldest;
+			m_native_resp.size = m_storage.size;
+		}
+
+	private:
+		void scan_window()
+		{
+			scan_tx_entries(m_tx_entries, m_accounts, m_parallel);
+
+			std::vector<bool> lookahead_grown(m_accounts.size(), false);
+			for (auto &block_entry : m_block_entries) {
+				for (size_t j = block_entry.txs_begin; j < block_entry.txs_end; j++) {
+					auto &tx_entry = m_tx_entries[j];
+					if (!tx_entry.parsed)
+						continue;
+
+					block_entry.pruned_block.mixins.insert(block_entry.pruned_block.mixins.end(), tx_entry.mixins.begin(), tx_entry.mixins.end());
+
+					merge_tx_entry(tx_entry, m_accounts, m_spent, m_inputs_by_account, lookahead_grown, m_native_resp);
+				}
+
+				store_pruned_block(std::move(block_entry.pruned_block), m_storage);
+			}
+
+			m_block_entries.clear();
+			m_tx_entries.clear();
+			m_tx_blobs_used = 0;
+		}
+
+		std::map<std::string, WalletAccountParams> &m_wallet_accounts_params;
+		const ScanAccounts &m_accounts;
+		SpentIndex &m_spent;
+		std::vector<std::vector<crypto::key_image>> m_inputs_by_account; // scratch for merge_tx_entry()
+		bool m_parallel;
+		size_t m_window_txs;
+		PrunedBlockStorage &m_storage;
+		NativeResponse &m_native_resp;
+
+		std::vector<ScanBlockEntry> m_block_entries;
+		std::vector<ScanTxEntry> m_tx_entries;
+		std::deque<std::string> m_tx_blobs;
+		size_t m_tx_blobs_used = 0;
+	};
+
+	// Walks the Clarity blocks feed event by event instead of building a property tree of the whole response.
+	// Each block is handed to the scanner as soon as its object closes; keys may come in any order, so tx
+	// blobs are decoded straight into the scanner's reusable buffers and only fed once the block is complete.
+	// Without a scanner it is a dry run, which checks the whole feed without feeding anything; tx blobs are
+	// then only checked to be valid base64, not decoded.
+	class ClarityBlocksParser
+	{
+	public:
+		ClarityBlocksParser(const char *buffer, size_t length, BlockScanner *scanner)
+			: m_reader(buffer, length)
+			, m_scanner(scanner)
+		{
+		}
+
+		// Throws std::exception on malformed input
+		void parse()
+		{
+			const json_reader::Event event = m_reader.next();
+			if (event == json_reader::BeginArray) {
+				for (;;) {
+					const json_reader::Event element = m_reader.next();
+					if (element == json_reader::EndArray)
+						break;
+					expect(element == json_reader::BeginObject);
+					read_block();
+				}
+			} else if (event == json_reader::BeginObject) { // blocks keyed by anything, as ptree iteration allowed
+				for (;;) {
+					const json_reader::Event key = m_reader.next();
+					if (key == json_reader::EndObject)
+						break;
+					expect(key == json_reader::Key);
+					expect(m_reader.next() == json_reader::BeginObject);
+					read_block();
+				}
+			} else {
+				expect(false);
+			}
+			expect(m_reader.next() == json_reader::End);
+		}
+
+	private:
+		void expect(bool condition)
+		{
+			if (!condition) {
+				throw std::runtime_error("malformed JSON");
+			}
+		}
+		void require(bool condition, const char *field)
+		{
+			if (!condition) {
+				throw std::runtime_error(std::string("missing or invalid ") + field);
+			}
+		}
+
+		uint64_t read_uint64(const char *field)
+		{
+			const json_reader::Event event = m_reader.next();
+			uint64_t value = 0;
+			require((event == json_reader::Number || event == json_reader::String) && m_reader.uint64_value(value), field);
+			return value;
+		}
+
+		void skip_value()
+		{
+			expect(m_reader.skip(m_reader.next()));
+		}
+
+		void read_block()
+		{ // the reader is just past the block's opening brace
+			bool has_id = false, has_timestamp = false, has_tx_hashes = false, has_txs = false, has_output_indices = false;
+			uint64_t height = 0, timestamp = 0;
+			m_tx_hashes_count = 0;
+			m_output_indices_count = 0;
+			m_txs.clear();
+
+			for (;;) {
+				const json_reader::Event event = m_reader.next();
+				if (event == json_reader::EndObject)
+					break;
+				expect(event == json_reader::Key);
+
+				if (m_reader.is("id")) {
+					height = read_uint64("id");
+					has_id = true;
+				} else if (m_reader.is("block")) {
+					read_block_body(has_timestamp, timestamp, has_tx_hashes);
+				} else if (m_reader.is("txs")) {
+					read_txs();
+					has_txs = true;
+				} else if (m_reader.is("outputIndices")) {
+					read_output_indices();
+					has_output_indices = true;
+				} else {
+					skip_value();
+				}
+			}
+
+			require(has_id, "id");
+			require(has_timestamp, "block.block_header.timestamp");
+			require(has_tx_hashes && m_tx_hashes_count >= m_txs.size(), "block.transaction_hashes");
+			require(has_txs, "txs");
+			require(has_output_indices && m_output_indices_count >= m_txs.size() + 1, "outputIndices");
+
+			if (!m_scanner)
+				return;
+			m_scanner->begin_block(height, timestamp);
+			for (size_t j = 0; j < m_txs.size(); j++) {
+				m_scanner->add_tx(m_txs[j], m_tx_hashes[j], m_output_indices[j + 1]);
+			}
+			m_scanner->end_block();
+		}
+
+		void read_block_body(bool &has_timestamp, uint64_t &timestamp, bool &has_tx_hashes)
+		{
+			expect(m_reader.next() == json_reader::BeginObject);
+			for (;;) {
+				const json_reader::Event event = m_reader.next();
+				if (event == json_reader::EndObject)
+					break;
+				expect(event == json_reader::Key);
+
+				if (m_reader.is("block_header")) {
+					expect(m_reader.next() == json_reader::BeginObject);
+					for (;;) {
+						const json_reader::Event header_event = m_reader.next();
+						if (header_event == json_reader::EndObject)
+							break;
+						expect(header_event == json_reader::Key);
+
+						if (m_reader.is("timestamp")) {
+							timestamp = read_uint64("block.block_header.timestamp");
+							has_timestamp = true;
+						} else {
+							skip_value();
+						}
+					}
+				} else if (m_reader.is("transaction_hashes")) {
+					expect(m_reader.next() == json_reader::BeginArray);
+					for (;;) {
+						const json_reader::Event hash_event = m_reader.next();
+						if (hash_event == json_reader::EndArray)
+							break;
+						require(hash_event == json_reader::String, "block.transaction_hashes");
+						if (m_tx_hashes_count == m_tx_hashes.size()) {
+							m_tx_hashes.emplace_back();
+						}
+						crypto::hash &hash = m_tx_hashes[m_tx_hashes_count++];
+						if (m_reader.raw_has_escapes() || !epee::string_tools::hex_to_pod(m_reader.raw(), hash)) {
+							hash = crypto::null_hash;
+						}
+					}
+					has_tx_hashes = true;
+				} else {
+					skip_value();
+				}
+			}
+		}
+
+		void read_txs()
+		{
+			expect(m_reader.next() == json_reader::BeginArray);
+			for (;;) {
+				const json_reader::Event event = m_reader.next();
+				if (event == json_reader::EndArray)
+					break;
+				require(event == json_reader::String, "txs");
+
+				boost::string_ref base64 = m_reader.raw();
+				if (m_reader.raw_has_escapes()) { // e.g. "\/", which JSON writers are free to emit
+					expect(json_reader::unescape(base64, m_unescaped));
+					base64 = m_unescaped;
+				}
+				if (!m_scanner) { // a dry run only checks that decode_base64() will not throw later
+					require(is_base64(base64.data(), base64.size()), "txs");
+					m_txs.push_back(cryptonote::blobdata_ref());
+					continue;
+				}
+				std::string &tx_blob = m_scanner->tx_blob_buffer();
+				decode_base64(base64.data(), base64.size(), tx_blob);
+				m_txs.push_back(cryptonote::blobdata_ref(tx_blob));
+			}
+		}
 
-using namespace std;
-using namespace boost;
-using namespace cryptonote;
-using namespace extend_helpers;
-using namespace device_trezor;
-using namespace monero_transfer_utils;
-using namespace monero_fork_rules;
-//
-using namespace serial_bridge;
-using namespace serial_bridge_utils;
+		void read_output_indices()
+		{
+			expect(m_reader.next() == json_reader::BeginArray);
+			for (;;) {
+				const json_reader::Event event = m_reader.next();
+				if (event == json_reader::EndArray)
+					break;
+				require(event == json_reader::BeginArray, "outputIndices");
+
+				if (m_output_indices_count == m_output_indices.size()) {
+					m_output_indices.emplace_back();
+				}
+				TxOutputIndices &indices = m_output_indices[m_output_indices_count++];
+				indices.clear();
+				for (;;) {
+					const json_reader::Event index_event = m_reader.next();
+					if (index_event == json_reader::EndArray)
+						break;
+					uint64_t index = 0;
+					require((index_event == json_reader::Number || index_event == json_reader::String) && m_reader.uint64_value(index), "outputIndices");
+					indices.push_back(index);
+				}
+			}
+		}
+
+		json_reader::Reader m_reader;
+		BlockScanner *m_scanner;
+
+		// Reused from block to block; only the first *_count entries belong to the current block
+		std::vector<crypto::hash> m_tx_hashes;
+		size_t m_tx_hashes_count = 0;
+		BlockOutputIndices m_output_indices;
+		size_t m_output_indices_count = 0;
+		std::vector<cryptonote::blobdata_ref> m_txs;
+		std::string m_unescaped;
+	};
+
+	void scan_blocks_response(ScanContext &context, const char *buffer, size_t length, NativeResponse &native_resp)
+	{
+		native_resp.binary = context.binary_result;
+
+		blocks_bin_reader::Reader reader(buffer, length);
+		if (!reader.init()) {
+			native_resp.error = "Network request failed";
+			return;
+		}
+
+		BlockScanner scanner(context, native_resp);
+
+		blocks_bin_reader::BlockView block_entry;
+		while (reader.next(block_entry)) {
+			cryptonote::block b;
+
+			crypto::hash block_hash;
+			if (!parse_and_validate_block_from_blob(block_entry.block, b, block_hash)) {
+				continue;
+			}
+
+			// the tx blobs come separately from the block's hashes of them, like the output indices
+			if (b.miner_tx.vin.empty() || b.tx_hashes.size() != block_entry.txs.size()) {
+				continue;
+			}
+			auto gen_tx = b.miner_tx.vin[0];
+			if (gen_tx.type() != typeid(cryptonote::txin_gen)) {
+				continue;
+			}
+
+			uint64_t height = boost::get<cryptonote::txin_gen>(gen_tx).height;
+
+			scanner.begin_block(height, b.timestamp);
+			if (context.storage.binary) {
+				scanner.add_miner_tx(b.miner_tx, block_entry.output_indices[0]);
+			}
+			for (size_t j = 0; j < block_entry.txs.size(); j++) {
+				scanner.add_tx(block_entry.txs[j], b.tx_hashes[j], block_entry.output_indices[j + 1]);
+			}
+			scanner.end_block();
+		}
+
+		scanner.finish();
+
+		native_resp.current_height = reader.current_height();
+	}
+
+	void scan_clarity_blocks_response(ScanContext &context, const char *buffer, size_t length, NativeResponse &native_resp)
+	{
+		native_resp.binary = context.binary_result;
+
+		// Windows are merged into the context and stored while the feed is still being read, so a malformed feed
+		// has to be rejected up front, the way blocks_bin_reader::Reader::init() does for getblocks.bin
+		try {
+			ClarityBlocksParser(buffer, length, nullptr).parse();
+		} catch (const std::exception& e) {
+			native_resp.error = std::string("Error processing blocks data from clarity: ") + e.what();
+			return;
+		}
+
+		BlockScanner scanner(context, native_resp);
+		ClarityBlocksParser(buffer, length, &scanner).parse();
+		scanner.finish();
+
+		native_resp.current_height = 0; // clarity does not return it in the blocks API, we need to get it from monitor
+	}
+
+	// Scan sessions keep a ScanContext alive between calls. Each session has its own mutex, so batches for one
+	// session are serialized while different sessions scan concurrently.
+	struct ScanSession
+	{
+		std::mutex mutex;
+		ScanContext context;
+		uint64_t end_height = 0;
+		bool failed = false; // a batch threw partway through merging, so the context is ahead of what the client got
+		std::chrono::steady_clock::time_point last_used; // guarded by scan_sessions_mutex
+	};
+
+	// A session holds its accounts' secret keys, so one the client stopped using without destroying it does not
+	// stay around for the life of the process
+	const std::chrono::minutes scan_session_idle_timeout(10);
+
+	std::mutex scan_sessions_mutex;
+	std::map<uint64_t, std::shared_ptr<ScanSession>> scan_sessions;
+	uint64_t next_scan_session_id = 1;
+
+	// Drops the sessions idle for longer than scan_session_idle_timeout that no call holds; with scan_sessions_mutex held
+	void expire_scan_sessions(std::chrono::steady_clock::time_point now)
+	{
+		for (auto it = scan_sessions.begin(); it != scan_sessions.end();) {
+			if (now - it->second->last_used > scan_session_idle_timeout && it->second.use_count() == 1) {
+				it = scan_sessions.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	std::shared_ptr<ScanSession> find_scan_session(const string &session_id)
+	{
+		uint64_t id;
+		if (!epee::string_tools::get_xtype_from_string(id, session_id)) {
+			return nullptr;
+		}
+
+		std::lock_guard<std::mutex> lock(scan_sessions_mutex);
+		const auto now = std::chrono::steady_clock::now();
+		expire_scan_sessions(now);
+		auto it = scan_sessions.find(id);
+		if (it == scan_sessions.end()) {
+			return nullptr;
+		}
+		it->second->last_used = now;
+		return it->second;
+	}
+
+	// For calls that run long enough to matter, once they are done
+	void touch_scan_session(ScanSession &session)
+	{
+		std::lock_guard<std::mutex> lock(scan_sessions_mutex);
+		session.last_used = std::chrono::steady_clock::now();
+	}
+
+	template<typename Scan>
+	NativeResponse scan_in_session(const string &session_id, Scan scan)
+	{
+		NativeResponse native_resp;
+
+		auto session = find_scan_session(session_id);
+		if (!session) {
+			native_resp.error = "Unknown scan session";
+			return native_resp;
+		}
+
+		std::lock_guard<std::mutex> lock(session->mutex);
+		if (session->failed) {
+			native_resp.error = "Scan session failed, it has to be created again";
+			return native_resp;
+		}
+
+		// Feeds are validated before any block is merged, so rejecting one leaves the context as it was. Anything
+		// thrown after that comes partway through merging windows, which cannot be undone: key images were taken
+		// out of the spent index and lookahead grew, so a retry of the batch would miss those inputs.
+		try {
+			scan(session->context, native_resp);
+		} catch (const std::exception &e) {
+			session->failed = true;
+			close_pruned_block_storage(session->context.storage); // counts the blocks the writer got to
+			native_resp = NativeResponse();
+			native_resp.error = e.what();
+		}
+
+		if (native_resp.error.empty()) {
+			session->end_height = std::max(session->end_height, native_resp.end_height);
+		} else {
+			// where the store stands, blocks of the failed batch included
+			native_resp.error_with_storage = true;
+			native_resp.latest = session->context.storage.latest;
+			native_resp.oldest = session->context.storage.oldest;
+			native_resp.size = session->context.storage.size;
+		}
+
+		touch_scan_session(*session);
+		return native_resp;
+	}
+}
 
 const char *serial_bridge::create_blocks_request(int height, size_t *length) {
 	crypto::hash genesis;
@@ -90,7 +1260,7 @@ const char *serial_bridge::create_blocks_request(int height, size_t *length) {
 	return (const char *)arr;
 }
 
-std::map<std::string, WalletAccountParams> serial_bridge::get_wallet_accounts_params(boost::property_tree::ptree tree) {
+std::map<std::string, WalletAccountParams> serial_bridge::get_wallet_accounts_params(boost::property_tree::ptree tree, const std::string &subaddress_cache_path) {
     std::map<std::string, WalletAccountParams> wallet_accounts_params;
     for (const auto &params_desc : tree) {
         WalletAccountParams wallet_account_params;
@@ -115,7 +1285,10 @@ std::map<std::string, WalletAccountParams> serial_bridge::get_wallet_accounts_pa
 
             for (const auto &send_tx_desc : *send_txs_child) {
                 assert(send_tx_desc.first.empty());
-                wallet_account_params.send_txs.insert(std::pair<std::string, bool>(send_tx_desc.second.get_value<std::string>(), true));
+                crypto::hash tx_hash;
+                if (epee::string_tools::hex_to_pod(send_tx_desc.second.get_value<std::string>(), tx_hash)) {
+                    wallet_account_params.send_txs.push_back(tx_hash);
+                }
             }
         }
 
@@ -123,14 +1296,15 @@ std::map<std::string, WalletAccountParams> serial_bridge::get_wallet_accounts_pa
         if (key_images_child) {
             for (const auto &image_desc : *key_images_child) {
                 assert(image_desc.first.empty());
-                wallet_account_params.gki.insert(std::pair<std::string, bool>(image_desc.second.get_value<std::string>(), true));
+                crypto::key_image key_image;
+                if (epee::string_tools::hex_to_pod(image_desc.second.get_value<std::string>(), key_image)) {
+                    wallet_account_params.gki.push_back(key_image);
+                }
             }
         }
 
         uint32_t subaddresses_count = params_desc.second.get<uint32_t>("subaddresses");
-
-        cryptonote::subaddress_index index = {0, 0};
-        expand_subaddresses(wallet_account_params.account_keys, wallet_account_params.subaddresses, index, subaddresses_count);
+        init_subaddresses(wallet_account_params, subaddresses_count, subaddress_cache_path);
 
         wallet_accounts_params.insert(std::make_pair(params_desc.first, wallet_account_params));
     }
@@ -147,403 +1321,328 @@ NativeResponse serial_bridge::extract_data_from_blocks_response(const char *buff
 		return native_resp;
 	}
 
-	std::string storage_path = json_root.get<string>("storage_path");
-	uint8_t storage_rate = json_root.get<uint8_t>("storage_percent");
-	uint64_t latest = json_root.get<uint64_t>("latest");
-	uint64_t oldest = json_root.get<uint64_t>("oldest");
-	uint64_t size = json_root.get<uint64_t>("size");
+	ScanContext context;
+	init_scan_context(json_root, context);
 
-	std::map<std::string, WalletAccountParams> wallet_accounts_params = serial_bridge::get_wallet_accounts_params(json_root.get_child("params_by_wallet_account"));
-	for (const auto &pair : wallet_accounts_params) {
-		native_resp.results_by_wallet_account.insert(std::make_pair(pair.first, ExtractTransactionsResult{}));
-	}
+	scan_blocks_response(context, buffer, length, native_resp);
 
-	std::string m_body(buffer, length);
+	return native_resp;
+}
+
+NativeResponse serial_bridge::extract_data_from_clarity_blocks_response(const char *buffer, size_t length, const string &args_string) {
+	NativeResponse native_resp;
 
-	cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response resp;
-	if (!epee::serialization::load_t_from_binary(resp, m_body)) {
-		native_resp.error = "Network request failed";
+	boost::property_tree::ptree json_root;
+	if (!parsed_json_root(args_string, json_root)) {
+		native_resp.error = "Invalid JSON";
 		return native_resp;
 	}
 
-	auto blocks = resp.blocks;
+	ScanContext context;
+	init_scan_context(json_root, context);
 
-	for (size_t i = 0; i < resp.blocks.size(); i++) {
-		auto block_entry = resp.blocks[i];
+	scan_clarity_blocks_response(context, buffer, length, native_resp);
 
-		PrunedBlock pruned_block;
-		cryptonote::block b;
+	return native_resp;
+}
 
-		crypto::hash block_hash;
-		if (!parse_and_validate_block_from_blob(block_entry.block, b, block_hash)) {
-			continue;
-		}
+std::string serial_bridge::extract_data_from_blocks_response_str(const char *buffer, size_t length, const string &args_string) {
+	auto resp = serial_bridge::extract_data_from_blocks_response(buffer, length, args_string);
+    return serial_bridge::native_response_to_str(resp);
+}
 
-		auto gen_tx = b.miner_tx.vin[0];
-		if (gen_tx.type() != typeid(cryptonote::txin_gen)) {
-			continue;
-		}
+std::string serial_bridge::extract_data_from_clarity_blocks_response_str(const char *buffer, size_t length, const string &args_string) {
+    auto resp = serial_bridge::extract_data_from_clarity_blocks_response(buffer, length, args_string);
+    return serial_bridge::native_response_to_str(resp);
+}
 
-		uint64_t height = boost::get<cryptonote::txin_gen>(gen_tx).height;
-		native_resp.end_height = std::max(native_resp.end_height, height);
+std::string serial_bridge::create_scan_session(const string &args_string) {
+	boost::property_tree::ptree json_root;
+	if (!parsed_json_root(args_string, json_root)) {
+		return error_ret_json_from_message("Invalid JSON");
+	}
 
-		pruned_block.block_height = height;
-		pruned_block.timestamp = b.timestamp;
-		for (size_t j = 0; j < block_entry.txs.size(); j++) {
-			auto tx_entry = block_entry.txs[j];
+	auto session = std::make_shared<ScanSession>();
+	try {
+		init_scan_context(json_root, session->context);
+	} catch (const std::exception &e) {
+		return error_ret_json_from_message(e.what());
+	}
 
-			cryptonote::transaction tx;
+	uint64_t id;
+	{
+		std::lock_guard<std::mutex> lock(scan_sessions_mutex);
+		const auto now = std::chrono::steady_clock::now();
+		expire_scan_sessions(now);
+		id = next_scan_session_id++;
+		session->last_used = now;
+		scan_sessions.insert(std::make_pair(id, session));
+	}
 
-			auto tx_parsed = cryptonote::parse_and_validate_tx_from_blob(tx_entry.blob, tx) || cryptonote::parse_and_validate_tx_base_from_blob(tx_entry.blob, tx);
-            if (!tx_parsed)
-				continue;
+	boost::property_tree::ptree root;
+	root.put("session_id", id);
 
-			std::vector<cryptonote::tx_extra_field> fields;
-			auto extra_parsed = cryptonote::parse_tx_extra(tx.extra, fields);
-			if (!extra_parsed)
-				continue;
+	return ret_json_from_root(root);
+}
 
-			BridgeTransaction bridge_tx;
-			bridge_tx.id = epee::string_tools::pod_to_hex(b.tx_hashes[j]);
-			bridge_tx.version = tx.version;
-			bridge_tx.timestamp = b.timestamp;
-			bridge_tx.block_height = height;
-			bridge_tx.rv = tx.rct_signatures;
-			bridge_tx.pub = get_extra_pub_key(fields);
-			bridge_tx.additional_pubs = get_extra_additional_tx_pub_keys(fields);
-			bridge_tx.fee_amount = get_fee(tx, bridge_tx);
-			bridge_tx.outputs = get_outputs(tx);
-
-			auto nonce = get_extra_nonce(fields);
-			if (!cryptonote::get_encrypted_payment_id_from_tx_extra_nonce(nonce, bridge_tx.payment_id8))
-			{
-				cryptonote::get_payment_id_from_tx_extra_nonce(nonce, bridge_tx.payment_id);
-			}
+NativeResponse serial_bridge::extract_data_from_blocks_response_in_session(const string &session_id, const char *buffer, size_t length) {
+	return scan_in_session(session_id, [&](ScanContext &context, NativeResponse &native_resp) {
+		scan_blocks_response(context, buffer, length, native_resp);
+	});
+}
 
-			if (bridge_tx.version == 2)
-			{
-				for (size_t k = 0; k < bridge_tx.outputs.size(); k++)
-				{
-					auto &output = bridge_tx.outputs[k];
+NativeResponse serial_bridge::extract_data_from_clarity_blocks_response_in_session(const string &session_id, const char *buffer, size_t length) {
+	return scan_in_session(session_id, [&](ScanContext &context, NativeResponse &native_resp) {
+		scan_clarity_blocks_response(context, buffer, length, native_resp);
+	});
+}
 
-					Mixin mixin;
-					mixin.global_index = resp.output_indices[i].indices[j + 1].indices[output.index];
-					mixin.public_key = output.pub;
-					mixin.rct = build_rct(bridge_tx.rv, output.index);
+std::string serial_bridge::extract_data_from_blocks_response_in_session_str(const string &session_id, const char *buffer, size_t length) {
+	auto resp = serial_bridge::extract_data_from_blocks_response_in_session(session_id, buffer, length);
+	return serial_bridge::native_response_to_str(resp);
+}
 
-					pruned_block.mixins.push_back(mixin);
-				}
-			}
+std::string serial_bridge::extract_data_from_clarity_blocks_response_in_session_str(const string &session_id, const char *buffer, size_t length) {
+	auto resp = serial_bridge::extract_data_from_clarity_blocks_response_in_session(session_id, buffer, length);
+	return serial_bridge::native_response_to_str(resp);
+}
 
-			for (auto &pair : wallet_accounts_params)
-			{
-				auto bridge_tx_copy = bridge_tx;
+std::string serial_bridge::update_scan_session(const string &args_string) {
+	boost::property_tree::ptree json_root;
+	if (!parsed_json_root(args_string, json_root)) {
+		return error_ret_json_from_message("Invalid JSON");
+	}
 
-				auto &wallet_account_params = pair.second;
-				bridge_tx_copy.inputs = wallet_account_params.has_send_txs ? get_inputs_with_send_txs(tx, bridge_tx_copy, wallet_account_params.send_txs) : get_inputs(tx, bridge_tx_copy, wallet_account_params.gki);
+	auto session = find_scan_session(json_root.get<string>("session_id", ""));
+	if (!session) {
+		return error_ret_json_from_message("Unknown scan session");
+	}
 
-				auto tx_utxos = extract_utxos_from_tx(bridge_tx_copy, wallet_account_params.account_keys, wallet_account_params.subaddresses);
+	std::lock_guard<std::mutex> lock(session->mutex);
+	if (session->failed) {
+		return error_ret_json_from_message("Scan session failed, it has to be created again");
+	}
+	ScanContext &context = session->context;
 
-				for (size_t k = 0; k < tx_utxos.size(); k++)
-				{
-					auto &utxo = tx_utxos[k];
-					utxo.global_index = resp.output_indices[i].indices[j + 1].indices[utxo.vout];
+	// Everything is read before anything is added, so a rejected update leaves the session as it was
+	struct AccountUpdate
+	{
+		size_t account; // into context.accounts
+		std::vector<crypto::hash> send_txs;
+		std::vector<crypto::key_image> key_images;
+	};
+	std::vector<AccountUpdate> updates;
+	try {
+		for (const auto &params_desc : json_root.get_child("params_by_wallet_account")) {
+			AccountUpdate update;
+			update.account = 0;
+			while (update.account < context.accounts.size() && context.accounts[update.account]->first != params_desc.first) {
+				update.account++;
+			}
+			if (update.account == context.accounts.size()) {
+				return error_ret_json_from_message("Unknown wallet account " + params_desc.first);
+			}
 
-					if (!wallet_account_params.has_send_txs)
-					{
-						wallet_account_params.gki.insert(std::pair<std::string, bool>(utxo.key_image, true));
+			// same parsing as get_wallet_accounts_params(), which skips values that are not hex of the right size
+			auto send_txs_child = params_desc.second.get_child_optional("send_txs");
+			if (send_txs_child) {
+				if (!context.accounts[update.account]->second.has_send_txs) {
+					return error_ret_json_from_message("send_txs can only be added to accounts the session was created with send_txs for");
+				}
+				for (const auto &send_tx_desc : *send_txs_child) {
+					crypto::hash tx_hash;
+					if (epee::string_tools::hex_to_pod(send_tx_desc.second.get_value<std::string>(), tx_hash)) {
+						update.send_txs.push_back(tx_hash);
 					}
 				}
-
-				bridge_tx_copy.utxos = tx_utxos;
-
-				if (bridge_tx_copy.utxos.size() != 0 || bridge_tx_copy.inputs.size() != 0)
-				{
-					auto &result = native_resp.results_by_wallet_account[pair.first];
-					result.txs.push_back(bridge_tx_copy);
+			}
+			auto key_images_child = params_desc.second.get_child_optional("key_images");
+			if (key_images_child) {
+				for (const auto &image_desc : *key_images_child) {
+					crypto::key_image key_image;
+					if (epee::string_tools::hex_to_pod(image_desc.second.get_value<std::string>(), key_image)) {
+						update.key_images.push_back(key_image);
+					}
 				}
 			}
+			updates.push_back(std::move(update));
 		}
+	} catch (const std::exception &e) {
+		return error_ret_json_from_message(e.what());
+	}
 
-#ifndef EMSCRIPTEN
-		if (pruned_block.block_height >= oldest && pruned_block.block_height <= latest)
-			continue;
-		if (size <= 100 || arc4random_uniform(100) < storage_rate)
-		{
-			std::ofstream f;
-			f.open(storage_path + std::to_string(pruned_block.block_height) + ".json");
-			f << ret_json_from_root(pruned_block_to_json(pruned_block));
-
-			if (f.good())
-			{
-				latest = std::max(latest, pruned_block.block_height);
-				oldest = std::min(oldest, pruned_block.block_height);
-				size += 1;
+	// as SpentIndex::add_accounts() would have had them at creation
+	for (const auto &update : updates) {
+		auto &wallet_account_params = context.accounts[update.account]->second;
+		for (const auto &hash : update.send_txs) {
+			wallet_account_params.send_txs.push_back(hash);
+			context.spent.send_txs.insert(hash, update.account);
+		}
+		for (const auto &image : update.key_images) {
+			wallet_account_params.gki.push_back(image);
+			if (!wallet_account_params.has_send_txs) {
+				context.spent.key_images.insert(image, update.account);
 			}
-
-			f.close();
 		}
-#endif
-	}
-
-	for (const auto& pair : wallet_accounts_params) {
-		auto &result = native_resp.results_by_wallet_account[pair.first];
-
-		result.subaddresses = pair.second.subaddresses.size();
 	}
 
-	native_resp.current_height = resp.current_height;
-	native_resp.latest = latest;
-	native_resp.oldest = oldest;
-	native_resp.size = size;
+	boost::property_tree::ptree root;
+	root.put("updated", true);
 
-	return native_resp;
+	return ret_json_from_root(root);
 }
 
-NativeResponse serial_bridge::extract_data_from_clarity_blocks_response(const char *buffer, size_t length, const string &args_string) {
-	NativeResponse native_resp;
-
+std::string serial_bridge::query_scan_session(const string &args_string) {
 	boost::property_tree::ptree json_root;
 	if (!parsed_json_root(args_string, json_root)) {
-		native_resp.error = "Invalid JSON";
-		return native_resp;
+		return error_ret_json_from_message("Invalid JSON");
 	}
 
-	std::string storage_path = json_root.get<string>("storage_path");
-	uint8_t storage_rate = json_root.get<uint8_t>("storage_percent");
-	uint64_t latest = json_root.get<uint64_t>("latest");
-	uint64_t oldest = json_root.get<uint64_t>("oldest");
-	uint64_t size = json_root.get<uint64_t>("size");
-
-	std::map<std::string, WalletAccountParams> wallet_accounts_params = serial_bridge::get_wallet_accounts_params(json_root.get_child("params_by_wallet_account"));
-	for (const auto &pair : wallet_accounts_params) {
-		native_resp.results_by_wallet_account.insert(std::make_pair(pair.first, ExtractTransactionsResult{}));
-	}
-
-	// Convert buffer to string for parsing to JSON
-	boost::property_tree::ptree blocks_json_root;
-    std::string json_string(buffer, length);
-    try {
-        std::stringstream ss(json_string);
-        boost::property_tree::read_json(ss, blocks_json_root);
-    } catch (const std::exception& e) {
-        native_resp.error = std::string("Error processing blocks data from clarity: ") + e.what();
-        return native_resp;
-    }
-
-    for (auto &block_json_root : blocks_json_root) {
-        boost::property_tree::ptree& block_entry = block_json_root.second;
-
-        uint64_t height = block_entry.get<uint64_t>("id");
-        auto& block = block_entry.get_child("block");
-
-        uint64_t timestamp = block.get<uint64_t>("block_header.timestamp");
-
-        std::vector<std::string> tx_hashes;
-        for (const auto& hash : block.get_child("transaction_hashes")) {
-            tx_hashes.push_back(hash.second.data());
-        }
-
-        std::vector<std::string> txs;
-        for (const auto& tx : block_entry.get_child("txs")) {
-            std::string tx_blob;
-            decode_base64(tx.second.data(), tx_blob);
-            txs.push_back(tx_blob);
-        }
-
-        BlockOutputIndices output_indices;
-        for (auto& output_index_array : block_entry.get_child("outputIndices")) {
-            TxOutputIndices indices;
-            for (auto& index : output_index_array.second) {
-                indices.push_back(index.second.get_value<uint64_t>());
-            }
-            output_indices.push_back(indices);
-        }
-
-        native_resp.end_height = std::max(native_resp.end_height, height);
-
-        PrunedBlock pruned_block;
-        pruned_block.block_height = height;
-		pruned_block.timestamp = timestamp;
-        for (size_t j = 0; j < txs.size(); j++) {
-            std::string tx_blob = txs[j];
-			cryptonote::transaction tx;
-
-			auto tx_parsed = cryptonote::parse_and_validate_tx_from_blob(tx_blob, tx) || cryptonote::parse_and_validate_tx_base_from_blob(tx_blob, tx);
-            if (!tx_parsed)
-				continue;
-
-			std::vector<cryptonote::tx_extra_field> fields;
-			auto extra_parsed = cryptonote::parse_tx_extra(tx.extra, fields);
-			if (!extra_parsed)
-				continue;
-
-			BridgeTransaction bridge_tx;
-			bridge_tx.id = tx_hashes[j];
-			bridge_tx.version = tx.version;
-			bridge_tx.timestamp = timestamp;
-			bridge_tx.block_height = height;
-			bridge_tx.rv = tx.rct_signatures;
-			bridge_tx.pub = get_extra_pub_key(fields);
-			bridge_tx.additional_pubs = get_extra_additional_tx_pub_keys(fields);
-			bridge_tx.fee_amount = get_fee(tx, bridge_tx);
-			bridge_tx.outputs = get_outputs(tx);
-
-			auto nonce = get_extra_nonce(fields);
-			if (!cryptonote::get_encrypted_payment_id_from_tx_extra_nonce(nonce, bridge_tx.payment_id8))
-			{
-				cryptonote::get_payment_id_from_tx_extra_nonce(nonce, bridge_tx.payment_id);
-			}
-
-			if (bridge_tx.version == 2)
-			{
-				for (size_t k = 0; k < bridge_tx.outputs.size(); k++)
-				{
-					auto &output = bridge_tx.outputs[k];
-
-					Mixin mixin;
-					mixin.global_index = output_indices[j + 1][output.index];
-					mixin.public_key = output.pub;
-					mixin.rct = build_rct(bridge_tx.rv, output.index);
-
-					pruned_block.mixins.push_back(mixin);
-				}
-			}
-
-			for (auto &pair : wallet_accounts_params)
-			{
-				auto bridge_tx_copy = bridge_tx;
-
-				auto &wallet_account_params = pair.second;
-				bridge_tx_copy.inputs = wallet_account_params.has_send_txs ? get_inputs_with_send_txs(tx, bridge_tx_copy, wallet_account_params.send_txs) : get_inputs(tx, bridge_tx_copy, wallet_account_params.gki);
-
-				auto tx_utxos = extract_utxos_from_tx(bridge_tx_copy, wallet_account_params.account_keys, wallet_account_params.subaddresses);
-
-				for (size_t k = 0; k < tx_utxos.size(); k++)
-				{
-					auto &utxo = tx_utxos[k];
-					utxo.global_index = output_indices[j + 1][utxo.vout];
-
-					if (!wallet_account_params.has_send_txs)
-					{
-						wallet_account_params.gki.insert(std::pair<std::string, bool>(utxo.key_image, true));
-					}
-				}
+	auto session = find_scan_session(json_root.get<string>("session_id", ""));
+	if (!session) {
+		return error_ret_json_from_message("Unknown scan session");
+	}
 
-				bridge_tx_copy.utxos = tx_utxos;
+	std::lock_guard<std::mutex> lock(session->mutex);
+	const ScanContext &context = session->context;
 
-				if (bridge_tx_copy.utxos.size() != 0 || bridge_tx_copy.inputs.size() != 0)
-				{
-					auto &result = native_resp.results_by_wallet_account[pair.first];
-					result.txs.push_back(bridge_tx_copy);
-				}
-			}
-		}
+	boost::property_tree::ptree root;
+	root.put("session_id", json_root.get<string>("session_id"));
+	root.put("end_height", session->end_height);
+	root.put("latest", context.storage.latest);
+	root.put("oldest", context.storage.oldest);
+	root.put("size", context.storage.size);
 
-#ifndef EMSCRIPTEN
-		if (pruned_block.block_height >= oldest && pruned_block.block_height <= latest)
-			continue;
-		if (size <= 100 || arc4random_uniform(100) < storage_rate)
-		{
-			std::ofstream f;
-			f.open(storage_path + std::to_string(pruned_block.block_height) + ".json");
-			f << ret_json_from_root(pruned_block_to_json(pruned_block));
+	boost::property_tree::ptree results_tree;
+	for (const auto &pair : context.wallet_accounts_params) {
+		boost::property_tree::ptree result_tree;
+		result_tree.put("subaddresses", pair.second.subaddresses.size());
+		results_tree.add_child(pair.first, result_tree);
+	}
+	root.add_child("results", results_tree);
 
-			if (f.good())
-			{
-				latest = std::max(latest, pruned_block.block_height);
-				oldest = std::min(oldest, pruned_block.block_height);
-				size += 1;
-			}
+	return ret_json_from_root(root);
+}
 
-			f.close();
-		}
-#endif
+std::string serial_bridge::destroy_scan_session(const string &args_string) {
+	boost::property_tree::ptree json_root;
+	if (!parsed_json_root(args_string, json_root)) {
+		return error_ret_json_from_message("Invalid JSON");
 	}
 
-	for (const auto& pair : wallet_accounts_params) {
-		auto &result = native_resp.results_by_wallet_account[pair.first];
+	uint64_t id;
+	if (!epee::string_tools::get_xtype_from_string(id, json_root.get<string>("session_id", ""))) {
+		return error_ret_json_from_message("Unknown scan session");
+	}
 
-		result.subaddresses = pair.second.subaddresses.size();
+	std::shared_ptr<ScanSession> session;
+	{
+		std::lock_guard<std::mutex> lock(scan_sessions_mutex);
+		auto it = scan_sessions.find(id);
+		if (it == scan_sessions.end()) {
+			return error_ret_json_from_message("Unknown scan session");
+		}
+		session = it->second;
+		scan_sessions.erase(it);
 	}
+	// A batch still running in another thread holds its own reference and finishes first
+	std::lock_guard<std::mutex> lock(session->mutex);
 
-	native_resp.current_height = 0; // clarity does not return it in the blocks API, we need to get it from monitor
-	native_resp.latest = latest;
-	native_resp.oldest = oldest;
-	native_resp.size = size;
+	boost::property_tree::ptree root;
+	root.put("destroyed", true);
 
-	return native_resp;
+	return ret_json_from_root(root);
 }
 
-std::string serial_bridge::extract_data_from_blocks_response_str(const char *buffer, size_t length, const string &args_string) {
-	auto resp = serial_bridge::extract_data_from_blocks_response(buffer, length, args_string);
-    return serial_bridge::native_response_to_json_str(resp);
-}
+std::string serial_bridge::native_response_to_str(const NativeResponse &resp) {
+    if (!resp.error.empty() || !resp.binary) {
+        return native_response_to_json_str(resp);
+    }
 
-std::string serial_bridge::extract_data_from_clarity_blocks_response_str(const char *buffer, size_t length, const string &args_string) {
-    auto resp = serial_bridge::extract_data_from_clarity_blocks_response(buffer, length, args_string);
-    return serial_bridge::native_response_to_json_str(resp);
+    std::string result;
+    if (!binary_result::encode(resp, result)) {
+        return error_ret_json_from_message("Unable to encode binary result");
+    }
+    return result;
 }
 
-std::string serial_bridge::native_response_to_json_str(const NativeResponse &resp) {
-    boost::property_tree::ptree root;
+std::string serial_bridge::native_response_to_json_str(const NativeResponse &resp) {
+    if (!resp.error.empty() && !resp.error_with_storage) {
+        return error_ret_json_from_message(resp.error);
+    }
+
+    std::string json;
+    json_writer::Writer writer(json);
 
     if (!resp.error.empty()) {
-        root.put(ret_json_key__any__err_msg(), resp.error);
-        return ret_json_from_root(root);
+        writer.begin_object();
+        writer.member(ret_json_key__any__err_msg(), resp.error);
+        writer.member("latest", resp.latest);
+        writer.member("oldest", resp.oldest);
+        writer.member("size", resp.size);
+        writer.end_object();
+        writer.finish();
+        return json;
     }
 
-    root.put("current_height", resp.current_height);
-    root.put("end_height", resp.end_height);
-    root.put("latest", resp.latest);
-    root.put("oldest", resp.oldest);
-    root.put("size", resp.size);
+    writer.begin_object();
+    writer.member("current_height", resp.current_height);
+    writer.member("end_height", resp.end_height);
+    writer.member("latest", resp.latest);
+    writer.member("oldest", resp.oldest);
+    writer.member("size", resp.size);
 
-    boost::property_tree::ptree results_tree;
+    writer.key("results");
+    writer.begin_object();
     for (const auto &pair : resp.results_by_wallet_account) {
-        boost::property_tree::ptree txs_tree;
-        for (const auto &tx : pair.second.txs) {
-            boost::property_tree::ptree tx_tree;
-
-            tx_tree.put("id", tx.id);
-            tx_tree.put("timestamp", tx.timestamp);
-            tx_tree.put("height", tx.block_height);
-            tx_tree.put("pub", epee::string_tools::pod_to_hex(tx.pub));
-
-            boost::property_tree::ptree additional_pubs_tree;
+        writer.key(pair.first);
+        writer.begin_object();
+
+        writer.key("txs");
+        writer.begin_array();
+        for (const auto &account_tx : pair.second.txs) {
+            const BridgeTransaction &tx = *account_tx.tx;
+
+            writer.begin_object();
+            writer.pod_member("id", tx.id);
+            writer.member("timestamp", tx.timestamp);
+            writer.member("height", tx.block_height);
+            writer.pod_member("pub", tx.pub);
+
+            writer.key("additional_pubs");
+            writer.begin_array();
             for (const auto& pub : tx.additional_pubs) {
-                boost::property_tree::ptree value;
-                value.put("", epee::string_tools::pod_to_hex(pub));
-
-                additional_pubs_tree.push_back(std::make_pair("", value));
+                writer.pod_value(pub);
             }
-            tx_tree.add_child("additional_pubs", additional_pubs_tree);
+            writer.end_array();
 
-            tx_tree.put("fee", tx.fee_amount);
+            writer.member("fee", tx.fee_amount);
 
             if (tx.payment_id8 != crypto::null_hash8) {
-                tx_tree.put("epid", epee::string_tools::pod_to_hex(tx.payment_id8));
+                writer.pod_member("epid", tx.payment_id8);
             }
             else if (tx.payment_id != crypto::null_hash) {
-                tx_tree.put("pid", epee::string_tools::pod_to_hex(tx.payment_id));
+                writer.pod_member("pid", tx.payment_id);
             }
 
-            tx_tree.add_child("inputs", inputs_to_json(tx.inputs));
-            tx_tree.add_child("utxos", utxos_to_json(tx.utxos, true));
+            writer.key("inputs");
+            write_inputs_json(writer, account_tx.inputs);
+            writer.key("utxos");
+            write_utxos_json(writer, account_tx.utxos, true);
 
-            txs_tree.push_back(std::make_pair("", tx_tree));
+            writer.end_object();
         }
+        writer.end_array();
 
-        boost::property_tree::ptree wallet_tree;
-        wallet_tree.add_child("txs", txs_tree);
-        wallet_tree.put("subaddresses", pair.second.subaddresses);
-
-        results_tree.add_child(pair.first, wallet_tree);
+        writer.member("subaddresses", pair.second.subaddresses);
+        writer.end_object();
     }
+    writer.end_object();
 
-    root.add_child("results", results_tree);
+    writer.end_object();
+    writer.finish();
 
-    return ret_json_from_root(root);
+    return json;
 }
 
 std::string serial_bridge::get_transaction_pool_hashes_str(const char *buffer, size_t length) {
@@ -607,47 +1706,19 @@ std::string serial_bridge::get_extra_nonce(const std::vector<cryptonote::tx_extr
 	return "";
 }
 
-std::vector<crypto::key_image> serial_bridge::get_inputs(const cryptonote::transaction &tx, const BridgeTransaction &bridge_tx, std::map<std::string, bool> &gki)
-{
-	std::vector<crypto::key_image> inputs;
-
-	for (size_t i = 0; i < tx.vin.size(); i++) {
-		auto &tx_in = tx.vin[i];
-		if (tx_in.type() != typeid(cryptonote::txin_to_key))
-			continue;
-
-		auto image = boost::get<cryptonote::txin_to_key>(tx_in).k_image;
-
-		auto it = gki.find(epee::string_tools::pod_to_hex(image));
-		if (it == gki.end())
-			continue;
-
-		gki.erase(it);
-
-		inputs.push_back(image);
-	}
-
-	return inputs;
-}
-
-std::vector<crypto::key_image> serial_bridge::get_inputs_with_send_txs(const cryptonote::transaction &tx, const BridgeTransaction &bridge_tx, std::map<std::string, bool> &send_txs)
+std::vector<crypto::key_image> serial_bridge::get_key_images(const cryptonote::transaction &tx)
 {
-	std::vector<crypto::key_image> inputs;
-
-	auto it = send_txs.find(bridge_tx.id);
-	if (it == send_txs.end())
-		return inputs;
+	std::vector<crypto::key_image> key_images;
 
 	for (size_t i = 0; i < tx.vin.size(); i++) {
 		auto &tx_in = tx.vin[i];
 		if (tx_in.type() != typeid(cryptonote::txin_to_key))
 			continue;
 
-		auto image = boost::get<cryptonote::txin_to_key>(tx_in).k_image;
-		inputs.push_back(image);
+		key_images.push_back(boost::get<cryptonote::txin_to_key>(tx_in).k_image);
 	}
 
-	return inputs;
+	return key_images;
 }
 
 std::vector<Output> serial_bridge::get_outputs(const cryptonote::transaction &tx)
@@ -655,11 +1726,11 @@ std::vector<Output> serial_bridge::get_outputs(const cryptonote::transaction &tx
 	std::vector<Output> outputs;
 
 	for (size_t i = 0; i < tx.vout.size(); i++) {
-		auto tx_out = tx.vout[i];
-		
+		const auto &tx_out = tx.vout[i];
+
 		Output output;
 		output.index = i;
-		output.amount = std::to_string(tx_out.amount);
+		output.amount = tx_out.amount;
 		crypto::public_key output_public_key;
 		if (!cryptonote::get_output_public_key(tx_out, output_public_key)) continue;
 		output.pub = output_public_key;
@@ -696,28 +1767,150 @@ rct::xmr_amount serial_bridge::get_fee(const cryptonote::transaction &tx, const
 	return 0;
 }
 
-std::string serial_bridge::build_rct(const rct::rctSig &rv, size_t index) {
-	switch (rv.type) {
-	case rct::RCTTypeSimple:
-	case rct::RCTTypeFull:
-	case rct::RCTTypeBulletproof:
-		return epee::string_tools::pod_to_hex(rv.outPk[index].mask) +
-			   epee::string_tools::pod_to_hex(rv.ecdhInfo[index].mask) +
-			   epee::string_tools::pod_to_hex(rv.ecdhInfo[index].amount).substr(0, 16);
-	case rct::RCTTypeBulletproof2:
-	case rct::RCTTypeCLSAG:
-	case rct::RCTTypeBulletproofPlus:
-		return epee::string_tools::pod_to_hex(rv.outPk[index].mask) +
-			   epee::string_tools::pod_to_hex(rv.ecdhInfo[index].amount).substr(0, 16);
-	default:
-		return "";
+//
+// Output amounts - specialised per RingCT type
+namespace {
+	constexpr bool rct_type_has_amounts(uint8_t type)
+	{
+		return type == rct::RCTTypeSimple || type == rct::RCTTypeFull || type == rct::RCTTypeBulletproof
+			|| type == rct::RCTTypeBulletproof2 || type == rct::RCTTypeCLSAG || type == rct::RCTTypeBulletproofPlus;
+	}
+	// Bulletproof2 and later keep just an 8 byte encrypted amount per output and derive the mask from the shared secret
+	constexpr bool rct_type_compact_ecdh(uint8_t type)
+	{
+		return type == rct::RCTTypeBulletproof2 || type == rct::RCTTypeCLSAG || type == rct::RCTTypeBulletproofPlus;
+	}
+
+	// Calls F::run<Type>(args...) for the given rv.type, so per output code is compiled once per type and the
+	// type is only switched on once per tx; unknown types get the RCTTypeNull version
+	template<typename F, typename... Args>
+	auto with_rct_type(uint8_t type, Args&&... args) -> decltype(F::template run<rct::RCTTypeNull>(std::forward<Args>(args)...))
+	{
+		switch (type) {
+		case rct::RCTTypeSimple: return F::template run<rct::RCTTypeSimple>(std::forward<Args>(args)...);
+		case rct::RCTTypeFull: return F::template run<rct::RCTTypeFull>(std::forward<Args>(args)...);
+		case rct::RCTTypeBulletproof: return F::template run<rct::RCTTypeBulletproof>(std::forward<Args>(args)...);
+		case rct::RCTTypeBulletproof2: return F::template run<rct::RCTTypeBulletproof2>(std::forward<Args>(args)...);
+		case rct::RCTTypeCLSAG: return F::template run<rct::RCTTypeCLSAG>(std::forward<Args>(args)...);
+		case rct::RCTTypeBulletproofPlus: return F::template run<rct::RCTTypeBulletproofPlus>(std::forward<Args>(args)...);
+		default: return F::template run<rct::RCTTypeNull>(std::forward<Args>(args)...);
+		}
+	}
+
+	// What decodeRct() and decodeRctSimple() do for one output, reading rv in place rather than taking a copy
+	template<uint8_t RctType>
+	rct::xmr_amount decode_rct_amount(const rct::rctSig &rv, const crypto::key_derivation &derivation, size_t index, hw::device &hwdev, rct::key &mask)
+	{
+		CHECK_AND_ASSERT_THROW_MES(index < rv.ecdhInfo.size() && index < rv.outPk.size(), "Bad index");
+
+		crypto::secret_key scalar;
+		hwdev.derivation_to_scalar(derivation, index, scalar);
+
+		rct::ecdhTuple ecdh_info = rv.ecdhInfo[index];
+		hwdev.ecdhDecode(ecdh_info, rct::sk2rct(scalar), rct_type_compact_ecdh(RctType));
+		mask = ecdh_info.mask;
+
+		CHECK_AND_ASSERT_THROW_MES(sc_check(mask.bytes) == 0, "warning, bad ECDH mask");
+		CHECK_AND_ASSERT_THROW_MES(sc_check(ecdh_info.amount.bytes) == 0, "warning, bad ECDH amount");
+		rct::key commitment;
+		rct::addKeys2(commitment, mask, ecdh_info.amount, rct::H);
+		CHECK_AND_ASSERT_THROW_MES(rct::equalKeys(rv.outPk[index].mask, commitment), "warning, amount decoded incorrectly, will be unable to spend");
+
+		return rct::h2d(ecdh_info.amount);
 	}
+
+	struct DecodeAmount
+	{
+		template<uint8_t RctType>
+		static rct::xmr_amount run(int version, const crypto::key_derivation &derivation, const rct::rctSig &rv, rct::xmr_amount amount, size_t index, rct::key &mask)
+		{
+			if (version == 2 && rct_type_has_amounts(RctType)) {
+				return decode_rct_amount<RctType>(rv, derivation, index, default_device(), mask);
+			}
+			return amount;
+		}
+	};
+
+	struct BuildRct
+	{
+		template<uint8_t RctType>
+		static OutputRct run(const rct::rctSig &rv, size_t index)
+		{
+			OutputRct rct;
+			if (rct_type_has_amounts(RctType)) {
+				unsigned char *p = rct.data;
+				memcpy(p, &rv.outPk[index].mask, sizeof(rct::key));
+				p += sizeof(rct::key);
+				if (!rct_type_compact_ecdh(RctType)) {
+					memcpy(p, &rv.ecdhInfo[index].mask, sizeof(rct::key));
+					p += sizeof(rct::key);
+				}
+				memcpy(p, &rv.ecdhInfo[index].amount, 8);
+				rct.size = p + 8 - rct.data;
+			}
+			return rct;
+		}
+	};
+
+	struct ScanTxOutputs
+	{
+		template<uint8_t RctType>
+		static void run(const BridgeTransaction &tx, const cryptonote::account_keys &account_keys, const subaddress_table::SubaddressTable &subaddresses, const crypto::key_derivation &derivation, const std::vector<crypto::key_derivation> &additional_derivations, hw::device &hwdev, std::vector<Utxo> &utxos, bool &has_candidates)
+		{
+			for (const Output &output : tx.outputs) {
+				boost::optional<subaddress_receive_info> subaddr_recv_info = subaddress_table::is_out_to_acc_precomp(subaddresses, output.pub, derivation, additional_derivations, output.index, hwdev, output.view_tag);
+				if (!subaddr_recv_info) {
+					// the output may still belong to a subaddress beyond the current lookahead
+					has_candidates = has_candidates
+						|| cryptonote::out_can_be_to_acc(output.view_tag, derivation, output.index, &hwdev)
+						|| (output.index < additional_derivations.size() && cryptonote::out_can_be_to_acc(output.view_tag, additional_derivations[output.index], output.index, &hwdev));
+					continue;
+				}
+
+				Utxo utxo;
+				utxo.tx_id = tx.id;
+				utxo.index = subaddr_recv_info->index;
+				utxo.vout = output.index;
+				utxo.derivation = subaddr_recv_info->derivation;
+				if (tx.version == 2 && rct_type_has_amounts(RctType)) {
+					utxo.amount = decode_rct_amount<RctType>(tx.rv, subaddr_recv_info->derivation, output.index, hwdev, utxo.mask);
+				} else {
+					utxo.amount = output.amount;
+				}
+				utxo.tx_pub = tx.pub;
+				utxo.pub = output.pub;
+				utxo.rv = BuildRct::run<RctType>(tx.rv, output.index);
+
+				if (account_keys.m_spend_secret_key != crypto::null_skey) {
+					cryptonote::keypair in_ephemeral;
+					crypto::key_image ki;
+
+					if(!generate_key_image_helper_precomp(account_keys, output.pub, subaddr_recv_info->derivation, output.index, subaddr_recv_info->index, in_ephemeral, ki, hwdev)) {
+						continue;
+					}
+
+					utxo.key_image = ki;
+				}
+
+				utxos.push_back(std::move(utxo));
+			}
+		}
+	};
+}
+
+std::string serial_bridge::OutputRct::hex() const {
+	return epee::string_tools::buff_to_hex_nodelimer(std::string(reinterpret_cast<const char *>(data), size));
+}
+OutputRct serial_bridge::build_rct(const rct::rctSig &rv, size_t index) {
+	return with_rct_type<BuildRct>(rv.type, rv, index);
 }
 
 BridgeTransaction serial_bridge::json_to_tx(boost::property_tree::ptree tx_desc) {
 	BridgeTransaction tx;
 
-	tx.id = tx_desc.get<string>("id");
+	if (!epee::string_tools::hex_to_pod(tx_desc.get<string>("id"), tx.id)) {
+		throw std::invalid_argument("Invalid 'tx_desc.id'");
+	}
 
 	optional<string> str = tx_desc.get_optional<string>("pub");
 	if (str == none) {
@@ -802,7 +1995,7 @@ BridgeTransaction serial_bridge::json_to_tx(boost::property_tree::ptree tx_desc)
 			throw std::invalid_argument("Invalid 'tx_desc.outputs.pub'");
 		}
 
-		output.amount = output_desc.second.get<string>("amount");
+		output.amount = stoull(output_desc.second.get<string>("amount"));
 
 		crypto::view_tag view_tag = crypto::view_tag{};
 		auto viewTagString = output_desc.second.get_optional<string>("view_tag");
@@ -828,6 +2021,41 @@ boost::property_tree::ptree serial_bridge::inputs_to_json(std::vector<crypto::ke
 
 	return root;
 }
+void serial_bridge::write_inputs_json(json_writer::Writer &writer, const std::vector<crypto::key_image> &inputs) {
+	writer.begin_array();
+	for (const auto &input : inputs) {
+		writer.pod_value(input);
+	}
+	writer.end_array();
+}
+void serial_bridge::write_utxos_json(json_writer::Writer &writer, const std::vector<Utxo> &utxos, bool native) {
+	writer.begin_array();
+	for (const auto &utxo : utxos) {
+		writer.begin_object();
+		writer.member("vout", utxo.vout);
+		writer.member("amount", utxo.amount);
+		if (utxo.key_image) {
+			writer.pod_member("key_image", *utxo.key_image);
+		} else {
+			writer.member("key_image", "");
+		}
+		writer.member("index_major", utxo.index.major);
+		writer.member("index_minor", utxo.index.minor);
+		writer.pod_member("derivation", utxo.derivation);
+		writer.pod_member("mask", utxo.mask);
+
+		if (native) {
+			writer.pod_member("pub", utxo.pub);
+			writer.member("global_index", utxo.global_index);
+			writer.key("rv");
+			writer.hex_value(utxo.rv.data, utxo.rv.size);
+		} else {
+			writer.pod_member("tx_id", utxo.tx_id);
+		}
+		writer.end_object();
+	}
+	writer.end_array();
+}
 boost::property_tree::ptree serial_bridge::utxos_to_json(std::vector<Utxo> utxos, bool native) {
 	boost::property_tree::ptree utxos_ptree;
 	BOOST_FOREACH (auto &utxo, utxos) {
@@ -836,7 +2064,7 @@ boost::property_tree::ptree serial_bridge::utxos_to_json(std::vector<Utxo> utxos
 
 		out_ptree.put("vout", utxo.vout);
 		out_ptree.put("amount", utxo.amount);
-		out_ptree.put("key_image", utxo.key_image);
+		out_ptree.put("key_image", utxo.key_image ? epee::string_tools::pod_to_hex(*utxo.key_image) : std::string());
 		out_ptree.put("index_major", utxo.index.major);
 		out_ptree.put("index_minor", utxo.index.minor);
 		out_ptree.put("derivation", epee::string_tools::pod_to_hex(utxo.derivation));
@@ -845,9 +2073,9 @@ boost::property_tree::ptree serial_bridge::utxos_to_json(std::vector<Utxo> utxos
 		if (native) {
 			out_ptree.put("pub", epee::string_tools::pod_to_hex(utxo.pub));
 			out_ptree.put("global_index", utxo.global_index);
-			out_ptree.put("rv", utxo.rv);
+			out_ptree.put("rv", utxo.rv.hex());
 		} else {
-			out_ptree.put("tx_id", utxo.tx_id);
+			out_ptree.put("tx_id", epee::string_tools::pod_to_hex(utxo.tx_id));
 		}
 
 		utxos_ptree.push_back(out_ptree_pair);
@@ -870,7 +2098,7 @@ boost::property_tree::ptree serial_bridge::pruned_block_to_json(const PrunedBloc
 		boost::property_tree::ptree mixin_tree;
 		mixin_tree.put("global_index", mixin.global_index);
 		mixin_tree.put("public_key", epee::string_tools::pod_to_hex(mixin.public_key));
-		mixin_tree.put("rct", mixin.rct);
+		mixin_tree.put("rct", mixin.rct.hex());
 
 		mixins_tree.push_back(std::make_pair("", mixin_tree));
 	}
@@ -880,33 +2108,13 @@ boost::property_tree::ptree serial_bridge::pruned_block_to_json(const PrunedBloc
 	return block_tree;
 }
 
-string serial_bridge::decode_amount(int version, crypto::key_derivation derivation, rct::rctSig rv, std::string amount, int index, rct::key& mask)
+rct::xmr_amount serial_bridge::decode_amount(int version, const crypto::key_derivation &derivation, const rct::rctSig &rv, rct::xmr_amount amount, size_t index, rct::key& mask)
 {
-	if (version == 1) {
-		return amount;
-	} else if (version == 2) {
-		crypto::secret_key scalar;
-		hw::get_device("default").derivation_to_scalar(derivation, index, scalar);
-
-		rct::xmr_amount decoded_amount;
-
-		if (rv.type == rct::RCTTypeFull) {
-			decoded_amount = rct::decodeRct(rv, rct::sk2rct(scalar), index, mask, hw::get_device("default"));
-		} else if (rv.type == rct::RCTTypeSimple || rv.type == rct::RCTTypeBulletproof || rv.type == rct::RCTTypeBulletproof2 || rv.type == rct::RCTTypeCLSAG || rv.type == rct::RCTTypeBulletproofPlus) {
-			decoded_amount = rct::decodeRctSimple(rv, rct::sk2rct(scalar), index, mask, hw::get_device("default"));
-		}
-
-		ostringstream decoded_amount_ss;
-		decoded_amount_ss << decoded_amount;
-
-		return decoded_amount_ss.str();
-	}
-
-	return "";
+	return with_rct_type<DecodeAmount>(rv.type, version, derivation, rv, amount, index, mask);
 }
-std::vector<Utxo> serial_bridge::extract_utxos_from_tx(BridgeTransaction tx, cryptonote::account_keys account_keys, std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses)
+std::vector<Utxo> serial_bridge::scan_tx_outputs(const BridgeTransaction &tx, const cryptonote::account_keys &account_keys, const subaddress_table::SubaddressTable &subaddresses, bool &has_candidates)
 {
-	hw::device &hwdev = hw::get_device("default");
+	hw::device &hwdev = default_device();
 
 	std::vector<Utxo> utxos;
 
@@ -927,133 +2135,530 @@ std::vector<Utxo> serial_bridge::extract_utxos_from_tx(BridgeTransaction tx, cry
 		additional_derivations.push_back(additional_derivation);
 	}
 
-	BOOST_FOREACH (Output &output, tx.outputs) {
-		boost::optional<subaddress_receive_info> subaddr_recv_info = is_out_to_acc_precomp(subaddresses, output.pub, derivation, additional_derivations, output.index, hwdev, output.view_tag);
-		if (!subaddr_recv_info) continue;
+	with_rct_type<ScanTxOutputs>(tx.rv.type, tx, account_keys, subaddresses, derivation, additional_derivations, hwdev, utxos, has_candidates);
 
-		Utxo utxo;
-		utxo.tx_id = tx.id;
-		utxo.index = subaddr_recv_info->index;
-		utxo.vout = output.index;
-		utxo.derivation = subaddr_recv_info->derivation;
-		utxo.amount = serial_bridge::decode_amount(tx.version, subaddr_recv_info->derivation, tx.rv, output.amount, output.index, utxo.mask);
-		utxo.tx_pub = tx.pub;
-		utxo.pub = output.pub;
-		utxo.rv = serial_bridge::build_rct(tx.rv, output.index);
+	return utxos;
+}
 
-		if (account_keys.m_spend_secret_key != crypto::null_skey) {
-			cryptonote::keypair in_ephemeral;
-			crypto::key_image ki;
+std::vector<Utxo> serial_bridge::extract_utxos_from_tx(const BridgeTransaction &tx, const cryptonote::account_keys &account_keys, subaddress_table::SubaddressTable &subaddresses)
+{
+	for (;;) {
+		bool has_candidates = false;
+		auto utxos = scan_tx_outputs(tx, account_keys, subaddresses, has_candidates);
 
-			if(!generate_key_image_helper_precomp(account_keys, output.pub, subaddr_recv_info->derivation, output.index, subaddr_recv_info->index, in_ephemeral, ki, hwdev)) {
-				continue;
+		const size_t subaddresses_before = subaddresses.size();
+		for (const auto &utxo : utxos) {
+			expand_subaddresses(account_keys, subaddresses, utxo.index);
+		}
+
+		// a grown lookahead may cover further outputs of this same tx
+		if (subaddresses.size() == subaddresses_before || !has_candidates) {
+			return utxos;
+		}
+	}
+}
+
+namespace {
+	struct ExtractUtxosAccountDesc
+	{
+		std::string id;
+		cryptonote::account_keys account_keys;
+		uint32_t subaddresses = 0;
+		bool valid = true;
+	};
+	struct ExtractUtxosArgs
+	{
+		std::vector<ExtractUtxosAccountDesc> accounts;
+		std::vector<BridgeTransaction> txs; // only the txs that parsed
+		std::string subaddress_cache_path;
+		bool binary_result = false;
+		size_t grain_size = 0;
+	};
+
+	// Reads the extract_utxos args straight off the caller's buffer, hex decoding keys from the raw JSON text
+	// instead of building a property tree and copying every field out of it. Malformed JSON fails the whole
+	// call; an account or tx with missing or invalid fields is left out, as json_to_tx() throwing used to do.
+	class ExtractUtxosArgsParser
+	{
+	public:
+		ExtractUtxosArgsParser(const char *buffer, size_t length)
+			: m_reader(buffer, length)
+		{
+		}
+
+		// Returns false with error() set if the args cannot be used at all
+		bool parse(ExtractUtxosArgs &args)
+		{
+			bool has_params = false, has_txs = false;
+			if (m_reader.next() != json_reader::BeginObject) {
+				return fail("Invalid JSON");
 			}
+			for (;;) {
+				const json_reader::Event event = m_reader.next();
+				if (event == json_reader::EndObject)
+					break;
+				if (event != json_reader::Key) {
+					return fail("Invalid JSON");
+				}
 
-			utxo.key_image = epee::string_tools::pod_to_hex(ki);
+				if (m_reader.is("params_by_wallet_account")) {
+					has_params = read_accounts(args.accounts);
+				} else if (m_reader.is("txs")) {
+					has_txs = read_txs(args.txs);
+				} else if (m_reader.is("subaddress_cache_path")) {
+					read_string(args.subaddress_cache_path);
+				} else if (m_reader.is("result_format")) {
+					std::string result_format;
+					args.binary_result = read_string(result_format) && result_format == "binary";
+				} else if (m_reader.is("grain_size")) {
+					uint64_t grain_size = 0;
+					args.grain_size = read_uint64(grain_size) ? grain_size : 0;
+				} else {
+					m_reader.skip(m_reader.next());
+				}
+				if (m_reader.failed()) {
+					return fail("Invalid JSON");
+				}
+			}
+			if (m_reader.next() != json_reader::End) {
+				return fail("Invalid JSON");
+			}
+			if (!has_params) {
+				return fail("Invalid 'params_by_wallet_account'");
+			}
+			if (!has_txs) {
+				return fail("Invalid 'txs'");
+			}
+			return true;
 		}
 
-		expand_subaddresses(account_keys, subaddresses, (*subaddr_recv_info).index);
+		const std::string &error() const { return m_error; }
 
-		utxos.push_back(utxo);
-	}
+	private:
+		bool fail(const char *error)
+		{
+			m_error = error;
+			return false;
+		}
 
-	return utxos;
+		// Each read_*() consumes the whole next value, whatever it turns out to be, and returns whether it was usable
+		bool read_raw(boost::string_ref &out)
+		{
+			const json_reader::Event event = m_reader.next();
+			if (event != json_reader::String || m_reader.raw_has_escapes()) { // hex never needs escapes
+				m_reader.skip(event);
+				return false;
+			}
+			out = m_reader.raw();
+			return true;
+		}
+		template<typename T>
+		bool read_hex(T &pod)
+		{
+			boost::string_ref hex;
+			return read_raw(hex) && epee::string_tools::hex_to_pod(hex, pod);
+		}
+		bool read_string(std::string &out)
+		{
+			const json_reader::Event event = m_reader.next();
+			if (event == json_reader::Number) {
+				out.assign(m_reader.raw().data(), m_reader.raw().size());
+				return true;
+			}
+			if (event == json_reader::String) {
+				return m_reader.string_value(out);
+			}
+			m_reader.skip(event);
+			return false;
+		}
+		bool read_uint64(uint64_t &out)
+		{
+			const json_reader::Event event = m_reader.next();
+			if ((event == json_reader::Number || event == json_reader::String) && m_reader.uint64_value(out)) {
+				return true;
+			}
+			m_reader.skip(event);
+			return false;
+		}
+		// Calls read_element() for every element of the array coming next; false if it is not an array
+		template<typename F>
+		bool read_array(F read_element)
+		{
+			const json_reader::Event event = m_reader.next();
+			if (event != json_reader::BeginArray) {
+				m_reader.skip(event);
+				return false;
+			}
+			for (;;) {
+				const json_reader::Event element = m_reader.next();
+				if (element == json_reader::EndArray || element == json_reader::Error)
+					return element == json_reader::EndArray;
+				read_element(element);
+				if (m_reader.failed())
+					return false;
+			}
+		}
+		// Calls read_member() for every key of the object whose opening brace was just read
+		template<typename F>
+		bool read_members(F read_member)
+		{
+			for (;;) {
+				const json_reader::Event event = m_reader.next();
+				if (event == json_reader::EndObject)
+					return true;
+				if (event != json_reader::Key)
+					return false;
+				read_member();
+				if (m_reader.failed())
+					return false;
+			}
+		}
+
+		bool read_accounts(std::vector<ExtractUtxosAccountDesc> &accounts)
+		{
+			const json_reader::Event event = m_reader.next();
+			if (event != json_reader::BeginObject) {
+				m_reader.skip(event);
+				return false;
+			}
+			return read_members([&]() {
+				accounts.emplace_back();
+				ExtractUtxosAccountDesc &account = accounts.back();
+				const bool has_id = m_reader.string_value(account.id);
+				const json_reader::Event params = m_reader.next();
+				if (!has_id || params != json_reader::BeginObject) {
+					account.valid = false;
+					m_reader.skip(params);
+					return;
+				}
+				account.account_keys.m_spend_secret_key = crypto::null_skey;
+				bool has_view_key = false, has_spend_key = false, has_subaddresses = false, sec_spend_key_valid = true;
+				read_members([&]() {
+					if (m_reader.is("sec_viewKey_string")) {
+						has_view_key = read_hex(account.account_keys.m_view_secret_key);
+					} else if (m_reader.is("pub_spendKey_string")) {
+						has_spend_key = read_hex(account.account_keys.m_account_address.m_spend_public_key);
+					} else if (m_reader.is("sec_spendKey_string")) {
+						sec_spend_key_valid = read_hex(account.account_keys.m_spend_secret_key);
+					} else if (m_reader.is("subaddresses")) {
+						uint64_t subaddresses = 0;
+						has_subaddresses = read_uint64(subaddresses) && subaddresses <= std::numeric_limits<uint32_t>::max();
+						account.subaddresses = subaddresses;
+					} else {
+						m_reader.skip(m_reader.next());
+					}
+				});
+				account.valid = has_view_key && has_spend_key && has_subaddresses && sec_spend_key_valid;
+			});
+		}
+
+		bool read_txs(std::vector<BridgeTransaction> &txs)
+		{
+			return read_array([&](json_reader::Event event) {
+				if (event != json_reader::BeginObject) {
+					m_reader.skip(event);
+					return;
+				}
+				txs.emplace_back();
+				if (!read_tx(txs.back())) {
+					txs.pop_back();
+				}
+			});
+		}
+
+		// Reads the tx object whose opening brace was just read; false if it lacks something or has an invalid field
+		bool read_tx(BridgeTransaction &tx)
+		{
+			bool valid = true, has_id = false, has_pub = false, has_additional_pubs = false, has_version = false, has_rv = false, has_outputs = false;
+			read_members([&]() {
+				if (m_reader.is("id")) {
+					has_id = read_hex(tx.id);
+				} else if (m_reader.is("pub")) {
+					has_pub = read_hex(tx.pub);
+				} else if (m_reader.is("additional_pubs")) {
+					has_additional_pubs = read_array([&](json_reader::Event element) {
+						crypto::public_key pub;
+						if (element == json_reader::String && !m_reader.raw_has_escapes() && epee::string_tools::hex_to_pod(m_reader.raw(), pub)) {
+							tx.additional_pubs.push_back(pub);
+						} else {
+							valid = false;
+							m_reader.skip(element);
+						}
+					});
+				} else if (m_reader.is("version")) {
+					uint64_t version = 0;
+					has_version = read_uint64(version) && version <= std::numeric_limits<uint8_t>::max();
+					tx.version = version;
+				} else if (m_reader.is("rv")) {
+					has_rv = read_rv(tx.rv);
+				} else if (m_reader.is("outputs")) {
+					has_outputs = read_array([&](json_reader::Event element) {
+						if (element != json_reader::BeginObject || tx.outputs.size() > std::numeric_limits<uint8_t>::max()) {
+							valid = false;
+							m_reader.skip(element);
+							return;
+						}
+						Output output;
+						output.index = tx.outputs.size();
+						bool has_output_pub = false, has_amount = false;
+						read_members([&]() {
+							if (m_reader.is("pub")) {
+								has_output_pub = read_hex(output.pub);
+							} else if (m_reader.is("amount")) {
+								has_amount = read_uint64(output.amount);
+							} else if (m_reader.is("view_tag")) {
+								crypto::view_tag view_tag = crypto::view_tag{};
+								if (read_hex(view_tag)) {
+									output.view_tag = view_tag;
+								} else {
+									valid = false;
+								}
+							} else {
+								m_reader.skip(m_reader.next());
+							}
+						});
+						valid = valid && has_output_pub && has_amount;
+						tx.outputs.push_back(output);
+					});
+				} else {
+					m_reader.skip(m_reader.next());
+				}
+			});
+			return valid && has_id && has_pub && has_additional_pubs && has_version && has_rv && has_outputs;
+		}
+
+		// ecdhInfo may come before type, so its hex is only decoded once the whole rv has been read
+		bool read_rv(rct::rctSig &rv)
+		{
+			const json_reader::Event event = m_reader.next();
+			if (event != json_reader::BeginObject) {
+				m_reader.skip(event);
+				return false;
+			}
+			bool valid = true, has_type = false, has_ecdh_info = false, has_out_pk = false;
+			uint64_t type = 0;
+			m_ecdh_info.clear();
+			read_members([&]() {
+				if (m_reader.is("type")) {
+					has_type = read_uint64(type);
+				} else if (m_reader.is("ecdhInfo")) {
+					has_ecdh_info = read_array([&](json_reader::Event element) {
+						if (element != json_reader::BeginObject) {
+							valid = false;
+							m_reader.skip(element);
+							return;
+						}
+						RawEcdhInfo ecdh_info;
+						read_members([&]() {
+							if (m_reader.is("mask")) {
+								read_raw(ecdh_info.mask);
+							} else if (m_reader.is("amount")) {
+								read_raw(ecdh_info.amount);
+							} else {
+								m_reader.skip(m_reader.next());
+							}
+						});
+						m_ecdh_info.push_back(ecdh_info);
+					});
+				} else if (m_reader.is("outPk")) {
+					has_out_pk = read_array([&](json_reader::Event element) {
+						auto outPk = rct::ctkey{};
+						bool has_mask = false;
+						if (element == json_reader::BeginObject) {
+							read_members([&]() {
+								if (m_reader.is("mask")) {
+									has_mask = read_hex(outPk.mask);
+								} else {
+									m_reader.skip(m_reader.next());
+								}
+							});
+						} else {
+							m_reader.skip(element);
+						}
+						valid = valid && has_mask;
+						rv.outPk.push_back(outPk); // rct keys aren't movable
+					});
+				} else {
+					m_reader.skip(m_reader.next());
+				}
+			});
+			if (!valid || !has_type || !has_ecdh_info || !has_out_pk) {
+				return false;
+			}
+
+			switch (type) {
+			case rct::RCTTypeNull:
+			case rct::RCTTypeSimple:
+			case rct::RCTTypeFull:
+			case rct::RCTTypeBulletproof:
+			case rct::RCTTypeBulletproof2:
+			case rct::RCTTypeCLSAG:
+			case rct::RCTTypeBulletproofPlus:
+				rv.type = type;
+				break;
+			default:
+				return false;
+			}
+			const bool amount_only = rv.type == rct::RCTTypeBulletproof2 || rv.type == rct::RCTTypeCLSAG || rv.type == rct::RCTTypeBulletproofPlus;
+			rv.ecdhInfo.reserve(m_ecdh_info.size());
+			for (const auto &raw : m_ecdh_info) {
+				auto ecdh_info = rct::ecdhTuple{};
+				if (amount_only) {
+					if (!epee::string_tools::hex_to_pod(raw.amount, (crypto::hash8 &)ecdh_info.amount)) {
+						return false;
+					}
+				} else if (!epee::string_tools::hex_to_pod(raw.mask, ecdh_info.mask) || !epee::string_tools::hex_to_pod(raw.amount, ecdh_info.amount)) {
+					return false;
+				}
+				rv.ecdhInfo.push_back(ecdh_info); // rct keys aren't movable
+			}
+			return true;
+		}
+
+		struct RawEcdhInfo
+		{
+			boost::string_ref mask;
+			boost::string_ref amount;
+		};
+
+		json_reader::Reader m_reader;
+		std::string m_error;
+		std::vector<RawEcdhInfo> m_ecdh_info; // reused from tx to tx
+	};
 }
 
 ExtractUtxosResponse serial_bridge::extract_utxos_raw(const string &args_string)
 {
 	ExtractUtxosResponse response;
 
-	boost::property_tree::ptree json_root;
-	if (!parsed_json_root(args_string, json_root)) {
-		response.error = error_ret_json_from_message("Invalid JSON");
+	ExtractUtxosArgs args;
+	ExtractUtxosArgsParser parser(args_string.data(), args_string.size());
+	if (!parser.parse(args)) {
+		response.error = error_ret_json_from_message(parser.error());
 		return response;
 	}
+	response.binary = args.binary_result;
 
 	std::map<std::string, WalletAccountParamsBase> wallet_accounts_params;
-	for (const auto& params_desc : json_root.get_child("params_by_wallet_account")) {
-		WalletAccountParamsBase wallet_account_params;
-
-		if (!epee::string_tools::hex_to_pod(params_desc.second.get<string>("sec_viewKey_string"), wallet_account_params.account_keys.m_view_secret_key)) {
-			continue;
-		}
-
-		if (!epee::string_tools::hex_to_pod(params_desc.second.get<string>("pub_spendKey_string"), wallet_account_params.account_keys.m_account_address.m_spend_public_key)) {
-			continue;
-		}
-
-		wallet_account_params.account_keys.m_spend_secret_key = crypto::null_skey;
-		auto secSpendKeyString = params_desc.second.get_optional<string>("sec_spendKey_string");
-		if (secSpendKeyString && !epee::string_tools::hex_to_pod(*secSpendKeyString, wallet_account_params.account_keys.m_spend_secret_key)) {
+	for (const auto &account : args.accounts) {
+		if (!account.valid || wallet_accounts_params.count(account.id) != 0) {
 			continue;
 		}
-
-		uint32_t subaddresses_count = params_desc.second.get<uint32_t>("subaddresses");
-
-		cryptonote::subaddress_index index = {0, 0};
-		expand_subaddresses(wallet_account_params.account_keys, wallet_account_params.subaddresses, index, subaddresses_count);
-
-		wallet_accounts_params.insert(std::make_pair(params_desc.first, wallet_account_params));
+		WalletAccountParamsBase &wallet_account_params = wallet_accounts_params[account.id];
+		wallet_account_params.account_keys = account.account_keys;
+		init_subaddresses(wallet_account_params, account.subaddresses, args.subaddress_cache_path);
 	}
 
 	for (const auto &pair : wallet_accounts_params) {
 		response.results_by_wallet_account.insert(std::make_pair(pair.first, ExtractUtxosResult{}));
 	}
 
-	tools::threadpool& tpool = tools::threadpool::getInstance();
-  	tools::threadpool::waiter waiter(tpool);
-	struct geniod_params
+	std::vector<std::map<std::string, WalletAccountParamsBase>::value_type *> accounts;
+	for (auto &pair : wallet_accounts_params) {
+		accounts.push_back(&pair);
+	}
+
+	// Workers only read the subaddress tables and write into their own txs' slots; lookahead grows in the merge below
+	struct ScannedTx
 	{
-		const BridgeTransaction &tx;
+		std::vector<std::vector<Utxo>> utxos_by_account;
+		std::vector<char> candidates_by_account;
 	};
-
-	auto geniod = [&](const BridgeTransaction &tx) {
-		for (auto& pair : wallet_accounts_params) {
-			auto tx_utxos = serial_bridge::extract_utxos_from_tx(tx, pair.second.account_keys, pair.second.subaddresses);
-
-			auto &result = response.results_by_wallet_account[pair.first];
-			result.utxos.insert(std::end(result.utxos), std::begin(tx_utxos), std::end(tx_utxos));
-		}
+	std::vector<ScannedTx> scanned_txs(args.txs.size());
+	for (auto &scanned : scanned_txs) {
+		scanned.utxos_by_account.resize(accounts.size());
+		scanned.candidates_by_account.resize(accounts.size(), 0);
+	}
+	const auto scan = [&](size_t i, size_t a) {
+		bool has_candidates = false;
+		scanned_txs[i].utxos_by_account[a] = scan_tx_outputs(args.txs[i], accounts[a]->second.account_keys, accounts[a]->second.subaddresses, has_candidates);
+		scanned_txs[i].candidates_by_account[a] = has_candidates;
 	};
 
-	for (const auto& tx_desc : json_root.get_child("txs")) {
-		assert(tx_desc.first.empty());
+	// Work is split by tx, unless there are too few txs to keep the pool busy and several accounts to scan each for,
+	// in which case it is split by tx and account
+	const size_t concurrency = std::max<size_t>(1, tools::threadpool::getInstance().get_max_concurrency());
+	if (accounts.size() > 1 && args.txs.size() < 4 * concurrency) {
+		run_in_chunks(args.txs.size() * accounts.size(), [&](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; k++) {
+				scan(k / accounts.size(), k % accounts.size());
+			}
+		}, args.grain_size);
+	} else {
+		run_in_chunks(args.txs.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				for (size_t a = 0; a < accounts.size(); a++) {
+					scan(i, a);
+				}
+			}
+		}, args.grain_size);
+	}
 
-		BridgeTransaction tx;
-		try {
-			tx = serial_bridge::json_to_tx(tx_desc.second);
+	// Merged in tx order, so the utxos come out in the same order however the txs were spread over the pool
+	std::vector<bool> lookahead_grown(accounts.size(), false);
+	std::vector<ExtractUtxosResult *> results;
+	for (const auto account : accounts) {
+		results.push_back(&response.results_by_wallet_account[account->first]);
+	}
+	for (size_t i = 0; i < args.txs.size(); i++) {
+		auto &scanned = scanned_txs[i];
+		for (size_t a = 0; a < accounts.size(); a++) {
+			bool grown = lookahead_grown[a];
+			auto tx_utxos = merged_tx_utxos(args.txs[i], std::move(scanned.utxos_by_account[a]), scanned.candidates_by_account[a], accounts[a]->second, grown);
+			lookahead_grown[a] = grown;
 
-			// submitting geniod function calls to the thread pool
-			tpool.submit(&waiter, [&, tx](){ geniod(tx); }, true);
-		} catch(std::invalid_argument err) {
-			continue;
+			auto &utxos = results[a]->utxos;
+			utxos.insert(std::end(utxos), std::make_move_iterator(std::begin(tx_utxos)), std::make_move_iterator(std::end(tx_utxos)));
 		}
 	}
 
-	THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
-
 	for (const auto& pair : wallet_accounts_params) {
 		auto &result = response.results_by_wallet_account[pair.first];
 		result.subaddresses = pair.second.subaddresses.size();
+
+		store_subaddresses(pair.second);
 	}
 
 	return response;
 }
 
-void serial_bridge::expand_subaddresses(cryptonote::account_keys account_keys, std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses, const cryptonote::subaddress_index& tx_index, uint32_t lookahead) {
+void serial_bridge::expand_subaddresses(const cryptonote::account_keys &account_keys, subaddress_table::SubaddressTable &subaddresses, const cryptonote::subaddress_index& tx_index, uint32_t lookahead) {
 	if (subaddresses.size() > (tx_index.minor + lookahead - 1)) return;
 
-	hw::device &hwdev = hw::get_device("default");
+	hw::device &hwdev = default_device();
 
 	const uint32_t begin = subaddresses.size();
 	const uint32_t end = get_subaddress_clamped_sum(tx_index.minor, lookahead);
 
 	cryptonote::subaddress_index index = {0, begin};
 
-	const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(account_keys, index.major, index.minor, end);
+	// Each key costs a scalar multiplication, so a cold start with a deep lookahead is split across the pool
+	std::vector<crypto::public_key> pkeys;
+	tools::threadpool& tpool = tools::threadpool::getInstance();
+	const uint32_t concurrency = std::max<uint32_t>(1, tpool.get_max_concurrency());
+	if (concurrency > 1 && end - begin >= 2 * SUBADDRESS_KEYS_PER_TASK) {
+		pkeys.resize(end - begin);
+
+		tools::threadpool::waiter waiter(tpool);
+		const uint32_t chunk_size = std::max<uint32_t>(SUBADDRESS_KEYS_PER_TASK, (end - begin + concurrency - 1) / concurrency);
+		for (uint32_t chunk_begin = begin; chunk_begin < end;) {
+			const uint32_t chunk_end = chunk_begin + std::min(chunk_size, end - chunk_begin);
+			tpool.submit(&waiter, [&account_keys, &hwdev, &pkeys, &index, begin, chunk_begin, chunk_end]() {
+				const std::vector<crypto::public_key> chunk = hwdev.get_subaddress_spend_public_keys(account_keys, index.major, chunk_begin, chunk_end);
+				std::copy(chunk.begin(), chunk.end(), pkeys.begin() + (chunk_begin - begin));
+			}, true);
+			chunk_begin = chunk_end;
+		}
+
+		THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+	} else {
+		pkeys = hwdev.get_subaddress_spend_public_keys(account_keys, index.major, index.minor, end);
+	}
+
+	subaddresses.reserve(end);
 	for (; index.minor < end; index.minor++) {
 		const crypto::public_key &D = pkeys[index.minor - begin];
-		subaddresses[D] = index;
+		subaddresses.insert(D, index);
 	}
 }
 
@@ -1197,56 +2802,231 @@ string serial_bridge::estimate_rct_tx_size(const string &args_string) {
 		// it will already have thrown an exception
 		return error_ret_json_from_message("Invalid JSON");
 	}
-	std::size_t size = monero_fee_utils::estimate_rct_tx_size(
-		stoul(json_root.get<string>("n_inputs")),
-		stoul(json_root.get<string>("mixin")),
-		stoul(json_root.get<string>("n_outputs")),
-		stoul(json_root.get<string>("extra_size")),
-		json_root.get<bool>("bulletproof"),
-		json_root.get<bool>("clsag"),
-		json_root.get<bool>("bulletproof_plus"),
-		json_root.get<bool>("use_view_tags"));
-	std::ostringstream o;
-	o << size;
-	//
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__generic_retVal(), o.str());
-	//
-	return ret_json_from_root(root);
+	std::size_t size = monero_fee_utils::estimate_rct_tx_size(
+		stoul(json_root.get<string>("n_inputs")),
+		stoul(json_root.get<string>("mixin")),
+		stoul(json_root.get<string>("n_outputs")),
+		stoul(json_root.get<string>("extra_size")),
+		json_root.get<bool>("bulletproof"),
+		json_root.get<bool>("clsag"),
+		json_root.get<bool>("bulletproof_plus"),
+		json_root.get<bool>("use_view_tags"));
+	std::ostringstream o;
+	o << size;
+	//
+	boost::property_tree::ptree root;
+	root.put(ret_json_key__generic_retVal(), o.str());
+	//
+	return ret_json_from_root(root);
+}
+//
+// Crypto primitives - one item per call, or a batch of items per call
+namespace {
+	// Each takes the args of one call and yields either its retVal or an error message
+	typedef bool (*CryptoItemFn)(const boost::property_tree::ptree &args, std::string &ret_val, std::string &err_msg);
+
+	bool generate_key_image_item(const boost::property_tree::ptree &args, std::string &ret_val, std::string &err_msg)
+	{
+		crypto::secret_key sec_viewKey{};
+		crypto::secret_key sec_spendKey{};
+		crypto::public_key pub_spendKey{};
+		crypto::public_key tx_pub_key{}; {
+			bool r = false;
+			r = epee::string_tools::hex_to_pod(std::string(args.get<string>("sec_viewKey_string")), sec_viewKey);
+			THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Invalid secret view key");
+			r = epee::string_tools::hex_to_pod(std::string(args.get<string>("sec_spendKey_string")), sec_spendKey);
+			THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Invalid secret spend key");
+			r = epee::string_tools::hex_to_pod(std::string(args.get<string>("pub_spendKey_string")), pub_spendKey);
+			THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Invalid public spend key");
+			r = epee::string_tools::hex_to_pod(std::string(args.get<string>("tx_pub_key")), tx_pub_key);
+			THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Invalid tx pub key");
+		}
+		monero_key_image_utils::KeyImageRetVals retVals;
+		bool r = monero_key_image_utils::new__key_image(
+			pub_spendKey, sec_spendKey, sec_viewKey, tx_pub_key,
+			stoull(args.get<string>("out_index")),
+			retVals);
+		if (!r) {
+			err_msg = "Unable to generate key image"; // TODO: return error string? (unwrap optional)
+			return false;
+		}
+		ret_val = epee::string_tools::pod_to_hex(retVals.calculated_key_image);
+		return true;
+	}
+	bool generate_key_derivation_item(const boost::property_tree::ptree &args, std::string &ret_val, std::string &err_msg)
+	{
+		public_key pub_key;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("pub"), pub_key)) {
+			err_msg = "Invalid 'pub'";
+			return false;
+		}
+		secret_key sec_key;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("sec"), sec_key)) {
+			err_msg = "Invalid 'sec'";
+			return false;
+		}
+		crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
+		if (!crypto::generate_key_derivation(pub_key, sec_key, derivation)) {
+			err_msg = "Unable to generate key derivation";
+			return false;
+		}
+		ret_val = epee::string_tools::pod_to_hex(derivation);
+		return true;
+	}
+	bool derive_public_key_item(const boost::property_tree::ptree &args, std::string &ret_val, std::string &err_msg)
+	{
+		crypto::key_derivation derivation;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("derivation"), derivation)) {
+			err_msg = "Invalid 'derivation'";
+			return false;
+		}
+		std::size_t output_index = stoul(args.get<string>("out_index"));
+		crypto::public_key base;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("pub"), base)) {
+			err_msg = "Invalid 'pub'";
+			return false;
+		}
+		crypto::public_key derived_key = AUTO_VAL_INIT(derived_key);
+		if (!crypto::derive_public_key(derivation, output_index, base, derived_key)) {
+			err_msg = "Unable to derive public key";
+			return false;
+		}
+		ret_val = epee::string_tools::pod_to_hex(derived_key);
+		return true;
+	}
+	bool derive_subaddress_public_key_item(const boost::property_tree::ptree &args, std::string &ret_val, std::string &err_msg)
+	{
+		crypto::key_derivation derivation;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("derivation"), derivation)) {
+			err_msg = "Invalid 'derivation'";
+			return false;
+		}
+		std::size_t output_index = stoul(args.get<string>("out_index"));
+		crypto::public_key out_key;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("output_key"), out_key)) {
+			err_msg = "Invalid 'output_key'";
+			return false;
+		}
+		crypto::public_key derived_key = AUTO_VAL_INIT(derived_key);
+		if (!crypto::derive_subaddress_public_key(out_key, derivation, output_index, derived_key)) {
+			err_msg = "Unable to derive public key";
+			return false;
+		}
+		ret_val = epee::string_tools::pod_to_hex(derived_key);
+		return true;
+	}
+	bool derivation_to_scalar_item(const boost::property_tree::ptree &args, std::string &ret_val, std::string &err_msg)
+	{
+		crypto::key_derivation derivation;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("derivation"), derivation)) {
+			err_msg = "Invalid 'derivation'";
+			return false;
+		}
+		std::size_t output_index = stoul(args.get<string>("output_index"));
+		crypto::ec_scalar scalar = AUTO_VAL_INIT(scalar);
+		crypto::derivation_to_scalar(derivation, output_index, scalar);
+		ret_val = epee::string_tools::pod_to_hex(scalar);
+		return true;
+	}
+	bool encrypt_payment_id_item(const boost::property_tree::ptree &args, std::string &ret_val, std::string &err_msg)
+	{
+		crypto::hash8 payment_id;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("payment_id"), payment_id)) {
+			err_msg = "Invalid 'payment_id'";
+			return false;
+		}
+		crypto::public_key public_key;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("public_key"), public_key)) {
+			err_msg = "Invalid 'public_key'";
+			return false;
+		}
+		crypto::secret_key secret_key;
+		if (!epee::string_tools::hex_to_pod(args.get<string>("secret_key"), secret_key)) {
+			err_msg = "Invalid 'secret_key'";
+			return false;
+		}
+		hw::device &hwdev = hw::get_device("default");
+		hwdev.encrypt_payment_id(payment_id, public_key, secret_key);
+		ret_val = epee::string_tools::pod_to_hex(payment_id);
+		return true;
+	}
+
+	string crypto_call(const string &args_string, CryptoItemFn fn)
+	{
+		boost::property_tree::ptree json_root;
+		if (!parsed_json_root(args_string, json_root)) {
+			// it will already have thrown an exception
+			return error_ret_json_from_message("Invalid JSON");
+		}
+		std::string ret_val, err_msg;
+		if (!fn(json_root, ret_val, err_msg)) {
+			return error_ret_json_from_message(err_msg);
+		}
+		boost::property_tree::ptree root;
+		root.put(ret_json_key__generic_retVal(), ret_val);
+		//
+		return ret_json_from_root(root);
+	}
+
+	// Args {"items": [<args of one call>, ...]}, result {"results": [{"retVal": ...} or {"err_msg": ...}, ...]} in
+	// the same order. Items run on the thread pool and fail independently, exceptions included.
+	string crypto_batch_call(const string &args_string, CryptoItemFn fn)
+	{
+		boost::property_tree::ptree json_root;
+		if (!parsed_json_root(args_string, json_root)) {
+			// it will already have thrown an exception
+			return error_ret_json_from_message("Invalid JSON");
+		}
+		auto items_tree = json_root.get_child_optional("items");
+		if (!items_tree) {
+			return error_ret_json_from_message("Invalid 'items'");
+		}
+
+		std::vector<const boost::property_tree::ptree *> items;
+		for (const auto &item_desc : *items_tree) {
+			items.push_back(&item_desc.second);
+		}
+		std::vector<std::string> ret_vals(items.size());
+		std::vector<std::string> err_msgs(items.size());
+		std::vector<char> succeeded(items.size(), 0);
+
+		run_in_chunks(items.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				try {
+					succeeded[i] = fn(*items[i], ret_vals[i], err_msgs[i]);
+				} catch (const std::exception &e) {
+					err_msgs[i] = e.what();
+				}
+			}
+		});
+
+		std::string json;
+		json_writer::Writer writer(json);
+		writer.begin_object();
+		writer.key("results");
+		writer.begin_array();
+		for (size_t i = 0; i < items.size(); i++) {
+			writer.begin_object();
+			if (succeeded[i]) {
+				writer.member(ret_json_key__generic_retVal(), ret_vals[i]);
+			} else {
+				writer.member(ret_json_key__any__err_msg(), err_msgs[i]);
+			}
+			writer.end_object();
+		}
+		writer.end_array();
+		writer.end_object();
+		writer.finish();
+
+		return json;
+	}
 }
 //
 string serial_bridge::generate_key_image(const string &args_string) {
-	boost::property_tree::ptree json_root;
-	if (!parsed_json_root(args_string, json_root)) {
-		// it will already have thrown an exception
-		return error_ret_json_from_message("Invalid JSON");
-	}
-	crypto::secret_key sec_viewKey{};
-	crypto::secret_key sec_spendKey{};
-	crypto::public_key pub_spendKey{};
-	crypto::public_key tx_pub_key{}; {
-		bool r = false;
-		r = epee::string_tools::hex_to_pod(std::string(json_root.get<string>("sec_viewKey_string")), sec_viewKey);
-		THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Invalid secret view key");
-		r = epee::string_tools::hex_to_pod(std::string(json_root.get<string>("sec_spendKey_string")), sec_spendKey);
-		THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Invalid secret spend key");
-		r = epee::string_tools::hex_to_pod(std::string(json_root.get<string>("pub_spendKey_string")), pub_spendKey);
-		THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Invalid public spend key");
-		r = epee::string_tools::hex_to_pod(std::string(json_root.get<string>("tx_pub_key")), tx_pub_key);
-		THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Invalid tx pub key");
-	}
-	monero_key_image_utils::KeyImageRetVals retVals;
-	bool r = monero_key_image_utils::new__key_image(
-		pub_spendKey, sec_spendKey, sec_viewKey, tx_pub_key,
-		stoull(json_root.get<string>("out_index")),
-		retVals);
-	if (!r) {
-		return error_ret_json_from_message("Unable to generate key image"); // TODO: return error string? (unwrap optional)
-	}
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__generic_retVal(), epee::string_tools::pod_to_hex(retVals.calculated_key_image));
-	//
-	return ret_json_from_root(root);
+	return crypto_call(args_string, generate_key_image_item);
+}
+string serial_bridge::generate_key_image_batch(const string &args_string) {
+	return crypto_batch_call(args_string, generate_key_image_item);
 }
 //
 string serial_bridge::send_step1__prepare_params_for_get_decoys(const string &args_string) { // TODO: possibly allow this fn to take tx sec key as an arg, although, random bit gen is now handled well by emscripten
@@ -1366,7 +3146,8 @@ string serial_bridge::pre_step2_tie_unspent_outs_to_mix_outs_for_all_future_tx_a
 	}
 	//
 	vector<RandomAmountOutputs> mix_outs_from_server;
-	BOOST_FOREACH(boost::property_tree::ptree::value_type &mix_out_desc, json_root.get_child("mix_outs")) {
+	optional<boost::property_tree::ptree &> optl__mix_outs_json = json_root.get_child_optional("mix_outs");
+	if (optl__mix_outs_json != none) BOOST_FOREACH(boost::property_tree::ptree::value_type &mix_out_desc, *optl__mix_outs_json) {
 		assert(mix_out_desc.first.empty()); // array elements have no names
 		auto amountAndOuts = RandomAmountOutputs{};
 		amountAndOuts.amount = stoull(mix_out_desc.second.get<string>("amount"));
@@ -1404,6 +3185,32 @@ string serial_bridge::pre_step2_tie_unspent_outs_to_mix_outs_for_all_future_tx_a
 		optl__prior_attempt_unspent_outs_to_mix_outs = std::move(prior_attempt_unspent_outs_to_mix_outs);
 	}
 	//
+	if (optl__mix_outs_json == none) {
+		// no decoys fetched from the server; pick them from the pruned blocks stored by the scanner instead
+		optional<string> optl__storage_path = json_root.get_optional<string>("storage_path");
+		if (optl__storage_path == none) {
+			return error_ret_json_from_message("Expected 'mix_outs' or 'storage_path'");
+		}
+		optional<string> optl__blockchain_height_string = json_root.get_optional<string>("blockchain_height");
+		if (optl__blockchain_height_string == none) {
+			return error_ret_json_from_message("Expected 'blockchain_height' with 'storage_path'");
+		}
+		// the same request new__req_params__get_random_outs would make: one set per out without decoys from a prior attempt
+		vector<string> decoy_req__amounts;
+		vector<uint64_t> using_outs_global_indices;
+		for (const auto &out : using_outs) {
+			using_outs_global_indices.push_back(out.global_index);
+			if (optl__prior_attempt_unspent_outs_to_mix_outs != none && optl__prior_attempt_unspent_outs_to_mix_outs->find(out.public_key) != optl__prior_attempt_unspent_outs_to_mix_outs->end()) {
+				continue;
+			}
+			decoy_req__amounts.push_back(out.rct != none && (*out.rct).size() > 0 ? "0" : RetVals_Transforms::str_from(out.amount));
+		}
+		string err_msg;
+		if (!decoy_picker::get_random_outs(*optl__storage_path, stoull(*optl__blockchain_height_string), decoy_req__amounts, monero_fork_rules::fixed_mixinsize() + 1, using_outs_global_indices, mix_outs_from_server, err_msg)) {
+			return error_ret_json_from_message(err_msg);
+		}
+	}
+	//
 	Tie_Outs_to_Mix_Outs_RetVals retVals;
 	monero_transfer_utils::pre_step2_tie_unspent_outs_to_mix_outs_for_all_future_tx_attempts(
 		retVals,
@@ -1569,283 +3376,283 @@ string serial_bridge::send_step2__try_create_transaction(const string &args_stri
 	return ret_json_from_root(root);
 }
 //
-string serial_bridge::decodeRct(const string &args_string) {
-	boost::property_tree::ptree json_root;
-	if (!parsed_json_root(args_string, json_root)) {
-		// it will already have thrown an exception
-		return error_ret_json_from_message("Invalid JSON");
-	}
-	rct::key sk;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("sk"), sk)) {
-		return error_ret_json_from_message("Invalid 'sk'");
-	}
-	unsigned int i = stoul(json_root.get<string>("i"));
-	// NOTE: this rv structure parsing could be factored but it presently does not implement a number of sub-components of rv, such as .pseudoOuts
-	auto rv_desc = json_root.get_child("rv");
-	rct::rctSig rv = AUTO_VAL_INIT(rv);
-	unsigned int rv_type_int = stoul(rv_desc.get<string>("type"));
-	// got to be a better way to do this
-	if (rv_type_int == rct::RCTTypeNull) {
-		rv.type = rct::RCTTypeNull;
-	} else if (rv_type_int == rct::RCTTypeSimple) {
-		rv.type = rct::RCTTypeSimple;
-	} else if (rv_type_int == rct::RCTTypeFull) {
-		rv.type = rct::RCTTypeFull;
-	} else if (rv_type_int == rct::RCTTypeBulletproof) {
-		rv.type = rct::RCTTypeBulletproof;
-	} else if (rv_type_int == rct::RCTTypeBulletproof2) {
-		rv.type = rct::RCTTypeBulletproof2;
-	} else if (rv_type_int == rct::RCTTypeCLSAG) {
-		rv.type = rct::RCTTypeCLSAG;
-	} else if (rv_type_int == rct::RCTTypeBulletproofPlus) {
-		rv.type = rct::RCTTypeBulletproofPlus;
-	} else {
-		return error_ret_json_from_message("Invalid 'rv.type'");
-	}
-	BOOST_FOREACH (boost::property_tree::ptree::value_type &ecdh_info_desc, rv_desc.get_child("ecdhInfo")) {
-		assert(ecdh_info_desc.first.empty()); // array elements have no names
-		auto ecdh_info = rct::ecdhTuple{};
-		if (!epee::string_tools::hex_to_pod(ecdh_info_desc.second.get<string>("mask"), ecdh_info.mask))
-		{
-			return error_ret_json_from_message("Invalid rv.ecdhInfo[].mask");
+namespace {
+	// Only the parts of rv needed to decode amounts: type, ecdhInfo and outPk masks. With short_amounts the
+	// Bulletproof2 and later ecdhInfo carry just the 8 byte amount, the way decodeRctSimple expects them.
+	bool parsed_rv(const boost::property_tree::ptree &rv_desc, bool short_amounts, rct::rctSig &rv, std::string &err_msg)
+	{
+		unsigned int rv_type_int = stoul(rv_desc.get<string>("type"));
+		// got to be a better way to do this
+		if (rv_type_int == rct::RCTTypeNull) {
+			rv.type = rct::RCTTypeNull;
+		} else if (rv_type_int == rct::RCTTypeSimple) {
+			rv.type = rct::RCTTypeSimple;
+		} else if (rv_type_int == rct::RCTTypeFull) {
+			rv.type = rct::RCTTypeFull;
+		} else if (rv_type_int == rct::RCTTypeBulletproof) {
+			rv.type = rct::RCTTypeBulletproof;
+		} else if (rv_type_int == rct::RCTTypeBulletproof2) {
+			rv.type = rct::RCTTypeBulletproof2;
+		} else if (rv_type_int == rct::RCTTypeCLSAG) {
+			rv.type = rct::RCTTypeCLSAG;
+		} else if (rv_type_int == rct::RCTTypeBulletproofPlus) {
+			rv.type = rct::RCTTypeBulletproofPlus;
+		} else {
+			err_msg = "Invalid 'rv.type'";
+			return false;
 		}
-		if (!epee::string_tools::hex_to_pod(ecdh_info_desc.second.get<string>("amount"), ecdh_info.amount))
-		{
-			return error_ret_json_from_message("Invalid rv.ecdhInfo[].amount");
+		const bool amount_only = short_amounts && (rv.type == rct::RCTTypeBulletproof2 || rv.type == rct::RCTTypeCLSAG || rv.type == rct::RCTTypeBulletproofPlus);
+		const auto &ecdh_info_descs = rv_desc.get_child("ecdhInfo");
+		rv.ecdhInfo.reserve(ecdh_info_descs.size());
+		for (const auto &ecdh_info_desc : ecdh_info_descs) {
+			assert(ecdh_info_desc.first.empty()); // array elements have no names
+			auto ecdh_info = rct::ecdhTuple{};
+			if (amount_only)
+			{
+				if (!epee::string_tools::hex_to_pod(ecdh_info_desc.second.get<string>("amount"), (crypto::hash8 &)ecdh_info.amount))
+				{
+					err_msg = "Invalid rv.ecdhInfo[].amount";
+					return false;
+				}
+			}
+			else
+			{
+				if (!epee::string_tools::hex_to_pod(ecdh_info_desc.second.get<string>("mask"), ecdh_info.mask))
+				{
+					err_msg = "Invalid rv.ecdhInfo[].mask";
+					return false;
+				}
+				if (!epee::string_tools::hex_to_pod(ecdh_info_desc.second.get<string>("amount"), ecdh_info.amount))
+				{
+					err_msg = "Invalid rv.ecdhInfo[].amount";
+					return false;
+				}
+			}
+			rv.ecdhInfo.push_back(ecdh_info); // rct keys aren't movable
+		}
+		const auto &outPk_descs = rv_desc.get_child("outPk");
+		rv.outPk.reserve(outPk_descs.size());
+		for (const auto &outPk_desc : outPk_descs) {
+			assert(outPk_desc.first.empty()); // array elements have no names
+			auto outPk = rct::ctkey{};
+			if (!epee::string_tools::hex_to_pod(outPk_desc.second.get<string>("mask"), outPk.mask))
+			{
+				err_msg = "Invalid rv.outPk[].mask";
+				return false;
+			}
+			// FIXME: does dest need to be placed on the key?
+			rv.outPk.push_back(outPk); // rct keys aren't movable
 		}
-		rv.ecdhInfo.push_back(ecdh_info); // rct keys aren't movable
+		return true;
 	}
-	BOOST_FOREACH (boost::property_tree::ptree::value_type &outPk_desc, rv_desc.get_child("outPk")) {
-		assert(outPk_desc.first.empty()); // array elements have no names
-		auto outPk = rct::ctkey{};
-		if (!epee::string_tools::hex_to_pod(outPk_desc.second.get<string>("mask"), outPk.mask))
-		{
-			return error_ret_json_from_message("Invalid rv.outPk[].mask");
+	bool decoded_rct_amount(const rct::rctSig &rv, bool simple, const rct::key &sk, unsigned int i, rct::key &mask, rct::xmr_amount &amount, std::string &err_msg)
+	{
+		try {
+			// presently this uses the default device but we could let a string be passed to switch the type
+			if (simple) {
+				amount = rct::decodeRctSimple(rv, sk, i, mask, hw::get_device("default"));
+			} else {
+				amount = rct::decodeRct(rv, sk, i, mask, hw::get_device("default"));
+			}
+		}
+		catch (std::exception const &e) {
+			err_msg = e.what();
+			return false;
 		}
-		// FIXME: does dest need to be placed on the key?
-		rv.outPk.push_back(outPk); // rct keys aren't movable
+		return true;
 	}
-	//
-	rct::key mask;
-	rct::xmr_amount /*uint64_t*/ decoded_amount;
-	try {
-		decoded_amount = rct::decodeRct(
-			rv, sk, i, mask,
-			hw::get_device("default") // presently this uses the default device but we could let a string be passed to switch the type
-		);
+
+	string decode_rct_call(const string &args_string, bool simple)
+	{
+		boost::property_tree::ptree json_root;
+		if (!parsed_json_root(args_string, json_root)) {
+			// it will already have thrown an exception
+			return error_ret_json_from_message("Invalid JSON");
+		}
+		rct::key sk;
+		if (!epee::string_tools::hex_to_pod(json_root.get<string>("sk"), sk)) {
+			return error_ret_json_from_message("Invalid 'sk'");
+		}
+		unsigned int i = stoul(json_root.get<string>("i"));
+		// NOTE: this does not implement a number of sub-components of rv, such as .pseudoOuts
+		rct::rctSig rv = AUTO_VAL_INIT(rv);
+		std::string err_msg;
+		if (!parsed_rv(json_root.get_child("rv"), simple, rv, err_msg)) {
+			return error_ret_json_from_message(err_msg);
+		}
+		//
+		rct::key mask;
+		rct::xmr_amount /*uint64_t*/ decoded_amount;
+		if (!decoded_rct_amount(rv, simple, sk, i, mask, decoded_amount, err_msg)) {
+			return error_ret_json_from_message(err_msg);
+		}
+		ostringstream decoded_amount_ss;
+		decoded_amount_ss << decoded_amount;
+		//
+		boost::property_tree::ptree root;
+		root.put(ret_json_key__decodeRct_mask(), epee::string_tools::pod_to_hex(mask));
+		root.put(ret_json_key__decodeRct_amount(), decoded_amount_ss.str());
+		//
+		return ret_json_from_root(root);
 	}
-	catch (std::exception const &e) {
-		return error_ret_json_from_message(e.what());
+
+	// One tx of decodeRct_batch(), its rv parsed once for all of its indices
+	struct DecodeRctItem
+	{
+		rct::key sk;
+		rct::rctSig rv;
+		bool simple;
+		std::vector<unsigned int> indices;
+		size_t first_output; // into the flat list of outputs
+		bool parsed;
+		std::string err_msg;
+	};
+	struct DecodeRctOutput
+	{
+		size_t item;
+		unsigned int index;
+		rct::key mask;
+		rct::xmr_amount amount;
+		bool decoded;
+		std::string err_msg;
+	};
+
+	bool parsed_decode_rct_item(const boost::property_tree::ptree &item_desc, DecodeRctItem &item)
+	{
+		if (!epee::string_tools::hex_to_pod(item_desc.get<string>("sk"), item.sk)) {
+			item.err_msg = "Invalid 'sk'";
+			return false;
+		}
+		const auto &rv_desc = item_desc.get_child("rv");
+		// Full rct txs are decoded with decodeRct and everything else with decodeRctSimple, like the scanner does
+		item.simple = stoul(rv_desc.get<string>("type")) != rct::RCTTypeFull;
+		if (!parsed_rv(rv_desc, item.simple, item.rv, item.err_msg)) {
+			return false;
+		}
+		for (const auto &index_desc : item_desc.get_child("indices")) {
+			item.indices.push_back(stoul(index_desc.second.get_value<string>()));
+		}
+		return true;
 	}
-	ostringstream decoded_amount_ss;
-	decoded_amount_ss << decoded_amount;
-	//
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__decodeRct_mask(), epee::string_tools::pod_to_hex(mask));
-	root.put(ret_json_key__decodeRct_amount(), decoded_amount_ss.str());
-	//
-	return ret_json_from_root(root);
+}
+//
+string serial_bridge::decodeRct(const string &args_string) {
+	return decode_rct_call(args_string, false);
 }
 //
 string serial_bridge::decodeRctSimple(const string &args_string) {
+	return decode_rct_call(args_string, true);
+}
+//
+string serial_bridge::decodeRct_batch(const string &args_string) {
 	boost::property_tree::ptree json_root;
 	if (!parsed_json_root(args_string, json_root)) {
 		// it will already have thrown an exception
 		return error_ret_json_from_message("Invalid JSON");
 	}
-	rct::key sk;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("sk"), sk)) {
-		return error_ret_json_from_message("Invalid 'sk'");
+	auto items_tree = json_root.get_child_optional("items");
+	if (!items_tree) {
+		return error_ret_json_from_message("Invalid 'items'");
 	}
-	unsigned int i = stoul(json_root.get<string>("i"));
-	// NOTE: this rv structure parsing could be factored but it presently does not implement a number of sub-components of rv, such as .pseudoOuts
-	auto rv_desc = json_root.get_child("rv");
-	rct::rctSig rv = AUTO_VAL_INIT(rv);
-	unsigned int rv_type_int = stoul(rv_desc.get<string>("type"));
-	// got to be a better way to do this
-	if (rv_type_int == rct::RCTTypeNull) {
-		rv.type = rct::RCTTypeNull;
-	} else if (rv_type_int == rct::RCTTypeSimple) {
-		rv.type = rct::RCTTypeSimple;
-	} else if (rv_type_int == rct::RCTTypeFull) {
-		rv.type = rct::RCTTypeFull;
-	} else if (rv_type_int == rct::RCTTypeBulletproof) {
-		rv.type = rct::RCTTypeBulletproof;
-	} else if (rv_type_int == rct::RCTTypeBulletproof2) {
-		rv.type = rct::RCTTypeBulletproof2;
-	} else if (rv_type_int == rct::RCTTypeCLSAG) {
-		rv.type = rct::RCTTypeCLSAG;
-	} else if (rv_type_int == rct::RCTTypeBulletproofPlus) {
-		rv.type = rct::RCTTypeBulletproofPlus;
-	} else {
-		return error_ret_json_from_message("Invalid 'rv.type'");
+	std::vector<const boost::property_tree::ptree *> item_descs;
+	for (const auto &item_desc : *items_tree) {
+		item_descs.push_back(&item_desc.second);
 	}
-	BOOST_FOREACH (boost::property_tree::ptree::value_type &ecdh_info_desc, rv_desc.get_child("ecdhInfo")) {
-		assert(ecdh_info_desc.first.empty()); // array elements have no names
-		auto ecdh_info = rct::ecdhTuple{};
-		if (rv.type == rct::RCTTypeBulletproof2 || rv.type == rct::RCTTypeCLSAG || rv.type == rct::RCTTypeBulletproofPlus)
-		{
-			if (!epee::string_tools::hex_to_pod(ecdh_info_desc.second.get<string>("amount"), (crypto::hash8 &)ecdh_info.amount))
-			{
-				return error_ret_json_from_message("Invalid rv.ecdhInfo[].amount");
+
+	std::vector<DecodeRctItem> items(item_descs.size());
+	run_in_chunks(items.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			try {
+				items[i].parsed = parsed_decode_rct_item(*item_descs[i], items[i]);
+			} catch (const std::exception &e) {
+				items[i].parsed = false;
+				items[i].err_msg = e.what();
 			}
 		}
-		else
-		{
-			if (!epee::string_tools::hex_to_pod(ecdh_info_desc.second.get<string>("mask"), ecdh_info.mask))
-			{
-				return error_ret_json_from_message("Invalid rv.ecdhInfo[].mask");
-			}
-			if (!epee::string_tools::hex_to_pod(ecdh_info_desc.second.get<string>("amount"), ecdh_info.amount))
-			{
-				return error_ret_json_from_message("Invalid rv.ecdhInfo[].amount");
-			}
+	});
+
+	// Decoding is spread per output rather than per tx, so that a few txs with many outputs still use every thread
+	std::vector<DecodeRctOutput> outputs;
+	for (size_t i = 0; i < items.size(); i++) {
+		items[i].first_output = outputs.size();
+		if (!items[i].parsed) {
+			continue;
 		}
-		rv.ecdhInfo.push_back(ecdh_info);
-	}
-	BOOST_FOREACH (boost::property_tree::ptree::value_type &outPk_desc, rv_desc.get_child("outPk")) {
-		assert(outPk_desc.first.empty()); // array elements have no names
-		auto outPk = rct::ctkey{};
-		if (!epee::string_tools::hex_to_pod(outPk_desc.second.get<string>("mask"), outPk.mask))
-		{
-			return error_ret_json_from_message("Invalid rv.outPk[].mask");
+		for (unsigned int index : items[i].indices) {
+			outputs.push_back({ i, index, rct::key{}, 0, false, std::string() });
 		}
-		// FIXME: does dest need to be placed on the key?
-		rv.outPk.push_back(outPk);
-	}
-	//
-	rct::key mask;
-	rct::xmr_amount /*uint64_t*/ decoded_amount;
-	try {
-		decoded_amount = rct::decodeRctSimple(
-			rv, sk, i, mask,
-			hw::get_device("default") // presently this uses the default device but we could let a string be passed to switch the type
-		);
 	}
-	catch (std::exception const &e) {
-		return error_ret_json_from_message(e.what());
+	run_in_chunks(outputs.size(), [&](size_t begin, size_t end) {
+		for (size_t o = begin; o < end; o++) {
+			auto &output = outputs[o];
+			const auto &item = items[output.item];
+			output.decoded = decoded_rct_amount(item.rv, item.simple, item.sk, output.index, output.mask, output.amount, output.err_msg);
+		}
+	});
+
+	std::string json;
+	json_writer::Writer writer(json);
+	writer.begin_object();
+	writer.key("results");
+	writer.begin_array();
+	for (const auto &item : items) {
+		writer.begin_object();
+		if (!item.parsed) {
+			writer.member(ret_json_key__any__err_msg(), item.err_msg);
+		} else {
+			writer.key("outputs");
+			writer.begin_array();
+			for (size_t o = item.first_output; o < item.first_output + item.indices.size(); o++) {
+				const auto &output = outputs[o];
+				writer.begin_object();
+				if (output.decoded) {
+					writer.pod_member(ret_json_key__decodeRct_mask(), output.mask);
+					writer.key(ret_json_key__decodeRct_amount());
+					writer.uint64_value(output.amount);
+				} else {
+					writer.member(ret_json_key__any__err_msg(), output.err_msg);
+				}
+				writer.end_object();
+			}
+			writer.end_array();
+		}
+		writer.end_object();
 	}
-	stringstream decoded_amount_ss;
-	decoded_amount_ss << decoded_amount;
-	//
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__decodeRct_mask(), epee::string_tools::pod_to_hex(mask));
-	root.put(ret_json_key__decodeRct_amount(), decoded_amount_ss.str());
-	//
-	return ret_json_from_root(root);
+	writer.end_array();
+	writer.end_object();
+	writer.finish();
+
+	return json;
 }
 string serial_bridge::generate_key_derivation(const string &args_string) {
-	boost::property_tree::ptree json_root;
-	if (!parsed_json_root(args_string, json_root)) {
-		// it will already have thrown an exception
-		return error_ret_json_from_message("Invalid JSON");
-	}
-	public_key pub_key;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("pub"), pub_key)) {
-		return error_ret_json_from_message("Invalid 'pub'");
-	}
-	secret_key sec_key;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("sec"), sec_key)) {
-		return error_ret_json_from_message("Invalid 'sec'");
-	}
-	crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
-	if (!crypto::generate_key_derivation(pub_key, sec_key, derivation)) {
-		return error_ret_json_from_message("Unable to generate key derivation");
-	}
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__generic_retVal(), epee::string_tools::pod_to_hex(derivation));
-	//
-	return ret_json_from_root(root);
+	return crypto_call(args_string, generate_key_derivation_item);
+}
+string serial_bridge::generate_key_derivation_batch(const string &args_string) {
+	return crypto_batch_call(args_string, generate_key_derivation_item);
 }
 string serial_bridge::derive_public_key(const string &args_string) {
-	boost::property_tree::ptree json_root;
-	if (!parsed_json_root(args_string, json_root)) {
-		// it will already have thrown an exception
-		return error_ret_json_from_message("Invalid JSON");
-	}
-	crypto::key_derivation derivation;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("derivation"), derivation)) {
-		return error_ret_json_from_message("Invalid 'derivation'");
-	}
-	std::size_t output_index = stoul(json_root.get<string>("out_index"));
-	crypto::public_key base;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("pub"), base)) {
-		return error_ret_json_from_message("Invalid 'pub'");
-	}
-	crypto::public_key derived_key = AUTO_VAL_INIT(derived_key);
-	if (!crypto::derive_public_key(derivation, output_index, base, derived_key)) {
-		return error_ret_json_from_message("Unable to derive public key");
-	}
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__generic_retVal(), epee::string_tools::pod_to_hex(derived_key));
-	//
-	return ret_json_from_root(root);
+	return crypto_call(args_string, derive_public_key_item);
+}
+string serial_bridge::derive_public_key_batch(const string &args_string) {
+	return crypto_batch_call(args_string, derive_public_key_item);
 }
 string serial_bridge::derive_subaddress_public_key(const string &args_string) {
-	boost::property_tree::ptree json_root;
-	if (!parsed_json_root(args_string, json_root)) {
-		// it will already have thrown an exception
-		return error_ret_json_from_message("Invalid JSON");
-	}
-	crypto::key_derivation derivation;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("derivation"), derivation)) {
-		return error_ret_json_from_message("Invalid 'derivation'");
-	}
-	std::size_t output_index = stoul(json_root.get<string>("out_index"));
-	crypto::public_key out_key;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("output_key"), out_key)) {
-		return error_ret_json_from_message("Invalid 'output_key'");
-	}
-	crypto::public_key derived_key = AUTO_VAL_INIT(derived_key);
-	if (!crypto::derive_subaddress_public_key(out_key, derivation, output_index, derived_key)) {
-		return error_ret_json_from_message("Unable to derive public key");
-	}
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__generic_retVal(), epee::string_tools::pod_to_hex(derived_key));
-	//
-	return ret_json_from_root(root);
+	return crypto_call(args_string, derive_subaddress_public_key_item);
+}
+string serial_bridge::derive_subaddress_public_key_batch(const string &args_string) {
+	return crypto_batch_call(args_string, derive_subaddress_public_key_item);
 }
 string serial_bridge::derivation_to_scalar(const string &args_string) {
-	boost::property_tree::ptree json_root;
-	if (!parsed_json_root(args_string, json_root)) {
-		// it will already have thrown an exception
-		return error_ret_json_from_message("Invalid JSON");
-	}
-	crypto::key_derivation derivation;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("derivation"), derivation)) {
-		return error_ret_json_from_message("Invalid 'derivation'");
-	}
-	std::size_t output_index = stoul(json_root.get<string>("output_index"));
-	crypto::ec_scalar scalar = AUTO_VAL_INIT(scalar);
-	crypto::derivation_to_scalar(derivation, output_index, scalar);
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__generic_retVal(), epee::string_tools::pod_to_hex(scalar));
-	//
-	return ret_json_from_root(root);
+	return crypto_call(args_string, derivation_to_scalar_item);
+}
+string serial_bridge::derivation_to_scalar_batch(const string &args_string) {
+	return crypto_batch_call(args_string, derivation_to_scalar_item);
 }
 string serial_bridge::encrypt_payment_id(const string &args_string) {
-	boost::property_tree::ptree json_root;
-	if (!parsed_json_root(args_string, json_root)) {
-		// it will already have thrown an exception
-		return error_ret_json_from_message("Invalid JSON");
-	}
-	crypto::hash8 payment_id;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("payment_id"), payment_id)) {
-		return error_ret_json_from_message("Invalid 'payment_id'");
-	}
-	crypto::public_key public_key;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("public_key"), public_key)) {
-		return error_ret_json_from_message("Invalid 'public_key'");
-	}
-	crypto::secret_key secret_key;
-	if (!epee::string_tools::hex_to_pod(json_root.get<string>("secret_key"), secret_key)) {
-		return error_ret_json_from_message("Invalid 'secret_key'");
-	}
-	hw::device &hwdev = hw::get_device("default");
-	hwdev.encrypt_payment_id(payment_id, public_key, secret_key);
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__generic_retVal(), epee::string_tools::pod_to_hex(payment_id));
-	return ret_json_from_root(root);
+	return crypto_call(args_string, encrypt_payment_id_item);
+}
+string serial_bridge::encrypt_payment_id_batch(const string &args_string) {
+	return crypto_batch_call(args_string, encrypt_payment_id_item);
 }
 string serial_bridge::extract_utxos(const string &args_string) {
 	auto response = serial_bridge::extract_utxos_raw(args_string);
@@ -1853,18 +3660,33 @@ string serial_bridge::extract_utxos(const string &args_string) {
 	if (!response.error.empty())
 		return response.error;
 
-	boost::property_tree::ptree root;
-	boost::property_tree::ptree results_tree;
-	for (const auto &pair : response.results_by_wallet_account) {
-		boost::property_tree::ptree wallet_tree;
-		wallet_tree.add_child("outputs", serial_bridge::utxos_to_json(pair.second.utxos));
-		wallet_tree.put("subaddresses", pair.second.subaddresses);
-
-		results_tree.add_child(pair.first, wallet_tree);
+	if (response.binary) {
+		std::string result;
+		if (!binary_result::encode(response, result)) {
+			return error_ret_json_from_message("Unable to encode binary result");
+		}
+		return result;
 	}
-	root.add_child("results", results_tree);
 
-	return ret_json_from_root(root);
+	std::string json;
+	json_writer::Writer writer(json);
+
+	writer.begin_object();
+	writer.key("results");
+	writer.begin_object();
+	for (const auto &pair : response.results_by_wallet_account) {
+		writer.key(pair.first);
+		writer.begin_object();
+		writer.key("outputs");
+		serial_bridge::write_utxos_json(writer, pair.second.utxos);
+		writer.member("subaddresses", pair.second.subaddresses);
+		writer.end_object();
+	}
+	writer.end_object();
+	writer.end_object();
+	writer.finish();
+
+	return json;
 }
 
 string serial_bridge::verify_trezor_key_image(const string &args_string) {
@@ -1904,4 +3726,27 @@ string serial_bridge::verify_trezor_key_image(const string &args_string) {
 	root.put(ret_json_key__generic_retVal(), !retVals.did_error);
 	//
 	return ret_json_from_root(root);
-}
\ No newline at end of file
+}
+string serial_bridge::get_pruned_blocks(const string &args_string) {
+	boost::property_tree::ptree json_root;
+	if (!parsed_json_root(args_string, json_root)) {
+		// it will already have thrown an exception
+		return error_ret_json_from_message("Invalid JSON");
+	}
+
+	pruned_block_store::Reader reader(json_root.get<string>("storage_path"));
+
+	boost::property_tree::ptree blocks_tree;
+	PrunedBlock pruned_block;
+	for (const auto &height_desc : json_root.get_child("heights")) {
+		assert(height_desc.first.empty());
+		if (reader.get(height_desc.second.get_value<uint64_t>(), pruned_block)) {
+			blocks_tree.push_back(std::make_pair("", serial_bridge::pruned_block_to_json(pruned_block)));
+		}
+	}
+
+	boost::property_tree::ptree root;
+	root.add_child("blocks", blocks_tree);
+	//
+	return ret_json_from_root(root);
+}
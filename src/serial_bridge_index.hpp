@@ -34,6 +34,7 @@
 #define serial_bridge_index_hpp
 //
 #include <string>
+#include <memory>
 #include <boost/property_tree/ptree.hpp>
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_config.h"
@@ -42,8 +43,11 @@
 #include "cryptonote_basic/tx_extra.h"
 #include "crypto/crypto.h"
 #include "ringct/rctTypes.h"
+#include "subaddress_table.hpp"
+#include "json_writer.hpp"
 
 #define SUBADDRESS_LOOKAHEAD_MINOR 200
+#define SUBADDRESS_KEYS_PER_TASK 256 // smallest share of a subaddress range derived on one pool thread
 
 typedef std::vector<uint64_t> TxOutputIndices;
 typedef std::vector<TxOutputIndices> BlockOutputIndices;
@@ -59,16 +63,26 @@ namespace serial_bridge
 	struct Output {
 		uint8_t index;
 		crypto::public_key pub;
-		string amount;
+		rct::xmr_amount amount; // plain amount; 0 for RingCT outputs, whose amount is in rv.ecdhInfo
 		boost::optional<crypto::view_tag> view_tag;
 	};
 
+	// An output's RingCT data the way clients get it as hex in "rv" and "rct": the commitment, the ecdh mask unless
+	// the type only keeps an encrypted amount, then the first 8 bytes of that amount; only the commitment of a
+	// coinbase output, zeroCommit(amount); empty without RingCT amounts
+	struct OutputRct {
+		uint8_t size = 0;
+		unsigned char data[32 + 32 + 8];
+
+		std::string hex() const;
+	};
+
 	struct UtxoBase {
-		string tx_id;
+		crypto::hash tx_id;
 		cryptonote::subaddress_index index;
 		uint8_t vout;
-		string amount;
-		string key_image;
+		rct::xmr_amount amount;
+		boost::optional<crypto::key_image> key_image; // only with a spend key
 		rct::key mask;
 		crypto::key_derivation derivation;
 	};
@@ -76,13 +90,14 @@ namespace serial_bridge
 	struct Utxo: public UtxoBase {
 		crypto::public_key tx_pub;
 		crypto::public_key pub;
-		std::string rv;
+		OutputRct rv;
 		uint64_t global_index;
 		uint64_t block_height;
 	};
 
+	// Immutable per-tx data; shared by every account the tx is relevant to
 	struct BridgeTransaction {
-		std::string id;
+		crypto::hash id;
 		uint8_t version;
 		uint64_t timestamp;
 		uint64_t block_height;
@@ -92,15 +107,21 @@ namespace serial_bridge
 		crypto::hash payment_id = crypto::null_hash;
 		crypto::hash8 payment_id8 = crypto::null_hash8;
 		rct::xmr_amount fee_amount = 0;
-		std::vector<crypto::key_image> inputs;
 		std::vector<Output> outputs;
+	};
+
+	// What a tx means to a single account
+	struct WalletAccountTransaction {
+		std::shared_ptr<const BridgeTransaction> tx;
+		std::vector<crypto::key_image> inputs;
 		std::vector<Utxo> utxos;
 	};
 
 	struct Mixin {
 		uint64_t global_index;
 		crypto::public_key public_key;
-		std::string rct;
+		OutputRct rct;
+		uint64_t unlock_time = 0; // of its tx; only the binary store keeps it, for decoy_picker
 	};
 
 	struct PrunedBlock {
@@ -111,13 +132,14 @@ namespace serial_bridge
 
 	struct WalletAccountParamsBase {
 		cryptonote::account_keys account_keys;
-		std::unordered_map<crypto::public_key, cryptonote::subaddress_index> subaddresses;
+		subaddress_table::SubaddressTable subaddresses;
+		std::string subaddress_cache_file; // empty unless the args have a subaddress_cache_path
 	};
 
 	struct WalletAccountParams : WalletAccountParamsBase {
 		bool has_send_txs = false;
-		std::map<std::string, bool> gki;
-		std::map<std::string, bool> send_txs;
+		std::vector<crypto::key_image> gki; // key images of known outputs, matched against tx inputs unless has_send_txs
+		std::vector<crypto::hash> send_txs;
 	};
 
 	struct ResultBase {
@@ -125,7 +147,7 @@ namespace serial_bridge
 	};
 
 	struct ExtractTransactionsResult : ResultBase {
-		std::vector<BridgeTransaction> txs;
+		std::vector<WalletAccountTransaction> txs;
 	};
 
 	struct ExtractUtxosResult : ResultBase {
@@ -140,11 +162,14 @@ namespace serial_bridge
 		uint64_t latest;
 		uint64_t oldest;
 		uint64_t size;
+		bool binary = false; // "result_format": "binary" in the args, see binary_result.hpp
+		bool error_with_storage = false; // latest, oldest and size are set alongside the error
 	};
 
 	struct ExtractUtxosResponse {
 		std::string error;
 		std::map<std::string, ExtractUtxosResult> results_by_wallet_account;
+		bool binary = false;
 	};
 
 	//
@@ -154,6 +179,22 @@ namespace serial_bridge
     NativeResponse extract_data_from_clarity_blocks_response(const char *buffer, size_t length, const string &args_string);
 	std::string extract_data_from_blocks_response_str(const char *buffer, size_t length, const string &args_string);
     std::string extract_data_from_clarity_blocks_response_str(const char *buffer, size_t length, const string &args_string);
+	//
+	// Scan sessions keep the accounts' subaddresses, key images and pruned block storage state between batches;
+	// create_scan_session takes the same args as the one-shot functions above and returns a session_id. A session
+	// unused for 10 minutes is dropped, with the keys it holds, and is then unknown like a destroyed one.
+	std::string create_scan_session(const string &args_string);
+	NativeResponse extract_data_from_blocks_response_in_session(const string &session_id, const char *buffer, size_t length);
+	NativeResponse extract_data_from_clarity_blocks_response_in_session(const string &session_id, const char *buffer, size_t length);
+	std::string extract_data_from_blocks_response_in_session_str(const string &session_id, const char *buffer, size_t length);
+	std::string extract_data_from_clarity_blocks_response_in_session_str(const string &session_id, const char *buffer, size_t length);
+	// Args {"session_id", "params_by_wallet_account": {<account>: {"send_txs": [...], "key_images": [...]}}}, both
+	// lists optional. Adds what the client learned since creating the session, e.g. the hash and key images of a
+	// tx it just sent, to match against blocks scanned from then on. send_txs only go to accounts created with them.
+	std::string update_scan_session(const string &args_string);
+	std::string query_scan_session(const string &args_string);
+	std::string destroy_scan_session(const string &args_string);
+	//
 	std::string get_transaction_pool_hashes_str(const char *buffer, size_t length);
 
 	//
@@ -161,28 +202,33 @@ namespace serial_bridge
 	crypto::public_key get_extra_pub_key(const std::vector<cryptonote::tx_extra_field> &fields);
 	std::vector<crypto::public_key> get_extra_additional_tx_pub_keys(const std::vector<cryptonote::tx_extra_field> &fields);
 	std::string get_extra_nonce(const std::vector<cryptonote::tx_extra_field> &fields);
-	std::vector<crypto::key_image> get_inputs(const cryptonote::transaction &tx, const BridgeTransaction &bridge_tx, std::map<std::string, bool> &gki);
-	std::vector<crypto::key_image> get_inputs_with_send_txs(const cryptonote::transaction &tx, const BridgeTransaction &bridge_tx, std::map<std::string, bool> &send_txs);
+	std::vector<crypto::key_image> get_key_images(const cryptonote::transaction &tx);
 	std::vector<Output> get_outputs(const cryptonote::transaction &tx);
 	rct::xmr_amount get_fee(const cryptonote::transaction &tx, const BridgeTransaction &bridge_tx);
-	std::string build_rct(const rct::rctSig &rv, size_t index);
+	OutputRct build_rct(const rct::rctSig &rv, size_t index);
 	BridgeTransaction json_to_tx(boost::property_tree::ptree tree);
 	boost::property_tree::ptree inputs_to_json(std::vector<crypto::key_image> inputs);
 	boost::property_tree::ptree utxos_to_json(std::vector<Utxo> utxos, bool native = false);
+	void write_inputs_json(json_writer::Writer &writer, const std::vector<crypto::key_image> &inputs);
+	void write_utxos_json(json_writer::Writer &writer, const std::vector<Utxo> &utxos, bool native = false);
 	boost::property_tree::ptree pruned_block_to_json(const PrunedBlock &pruned_block);
     std::string native_response_to_json_str(const NativeResponse &resp);
-	std::string decode_amount(int version, crypto::key_derivation derivation, rct::rctSig rv, std::string amount, int index, rct::key& mask);
-	std::vector<Utxo> extract_utxos_from_tx(BridgeTransaction tx, cryptonote::account_keys account_keys, std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses);
-    std::map<std::string, WalletAccountParams> get_wallet_accounts_params(boost::property_tree::ptree tree);
+	std::string native_response_to_str(const NativeResponse &resp); // JSON or binary, as resp.binary says
+	rct::xmr_amount decode_amount(int version, const crypto::key_derivation &derivation, const rct::rctSig &rv, rct::xmr_amount amount, size_t index, rct::key& mask);
+	std::vector<Utxo> scan_tx_outputs(const BridgeTransaction &tx, const cryptonote::account_keys &account_keys, const subaddress_table::SubaddressTable &subaddresses, bool &has_candidates);
+	std::vector<Utxo> extract_utxos_from_tx(const BridgeTransaction &tx, const cryptonote::account_keys &account_keys, subaddress_table::SubaddressTable &subaddresses);
+    std::map<std::string, WalletAccountParams> get_wallet_accounts_params(boost::property_tree::ptree tree, const std::string &subaddress_cache_path = "");
 
 	ExtractUtxosResponse extract_utxos_raw(const string &args_string);
 
-	void expand_subaddresses(cryptonote::account_keys account_keys, std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses, const cryptonote::subaddress_index& index, uint32_t lookahead = SUBADDRESS_LOOKAHEAD_MINOR);
+	void expand_subaddresses(const cryptonote::account_keys &account_keys, subaddress_table::SubaddressTable &subaddresses, const cryptonote::subaddress_index& index, uint32_t lookahead = SUBADDRESS_LOOKAHEAD_MINOR);
 	uint32_t get_subaddress_clamped_sum(uint32_t idx, uint32_t extra);
 
 	//
 	// Bridging Functions - these take and return JSON strings
 	string send_step1__prepare_params_for_get_decoys(const string &args_string);
+	// Without "mix_outs", decoys are picked from the binary pruned block store at "storage_path", which takes the
+	// current "blockchain_height" too; see decoy_picker.hpp for the stores it accepts
 	string pre_step2_tie_unspent_outs_to_mix_outs_for_all_future_tx_attempts(const string &args_string);
 	string send_step2__try_create_transaction(const string &args_string);
 	//
@@ -205,8 +251,21 @@ namespace serial_bridge
 	string decodeRctSimple(const string &args_string);
 	string encrypt_payment_id(const string &args_string);
 	//
+	// Batch variants - args {"items": [<args of one call>, ...]}, result {"results": [<result of one call>, ...]}
+	string generate_key_image_batch(const string &args_string);
+	string generate_key_derivation_batch(const string &args_string);
+	string derive_public_key_batch(const string &args_string);
+	string derive_subaddress_public_key_batch(const string &args_string);
+	string derivation_to_scalar_batch(const string &args_string);
+	string encrypt_payment_id_batch(const string &args_string);
+	// Args {"items": [{"sk", "rv", "indices": [...]}, ...]}, result {"results": [{"outputs": [{"mask", "amount"}, ...]}, ...]};
+	// rv.type picks decodeRct or decodeRctSimple per item
+	string decodeRct_batch(const string &args_string);
+	//
 	string extract_utxos(const string &args_string);
 	string verify_trezor_key_image(const string &args_string);
+	//
+	string get_pruned_blocks(const string &args_string); // from the "binary" storage_format; missing heights are left out
 }
 
 #endif /* serial_bridge_index_hpp */
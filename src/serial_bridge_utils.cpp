@@ -37,6 +37,7 @@
 #include "wallet_errors.h"
 using namespace tools;
 #include "string_tools.h"
+#include "json_writer.hpp"
 //
 //
 using namespace std;
@@ -127,17 +128,23 @@ bool serial_bridge_utils::parsed_json_root(const string &args_string, boost::pro
 // Shared - Factories - Return values
 string serial_bridge_utils::ret_json_from_root(const boost::property_tree::ptree &root)
 {
-	ostringstream ret_ss;
-	boost::property_tree::write_json(ret_ss, root, false/*pretty*/);
+	string json;
+	json_writer::Writer writer(json); // same output as write_json(root, false/*pretty*/), without the stream
+	writer.tree(root);
+	writer.finish();
 	//
-	return ret_ss.str();
+	return json;
 }
 string serial_bridge_utils::error_ret_json_from_message(const string &err_msg)
 {
-	boost::property_tree::ptree root;
-	root.put(ret_json_key__any__err_msg(), err_msg);
+	string json;
+	json_writer::Writer writer(json);
+	writer.begin_object();
+	writer.member(ret_json_key__any__err_msg(), err_msg);
+	writer.end_object();
+	writer.finish();
 	//
-	return ret_json_from_root(root);
+	return json;
 }
 string serial_bridge_utils::error_ret_json_from_code(int code, optional<string> err_msg)
 {
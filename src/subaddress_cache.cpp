@@ -0,0 +1,215 @@
+//
+//  subaddress_cache.cpp
+//
+#include "subaddress_cache.hpp"
+//
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+//
+#include "common/int-util.h"
+#include "crypto/hash.h"
+#include "device/device.hpp"
+#include "memwipe.h"
+#include "string_tools.h"
+
+using namespace std;
+//
+using namespace subaddress_cache;
+
+namespace {
+	const char MAGIC[8] = { 'M', 'M', 'S', 'U', 'B', 'A', 'D', '2' };
+	const size_t ACCOUNT_HASH_SIZE = 24;
+	const size_t COUNT_OFFSET = 32;
+	const size_t CHECKSUM_OFFSET = 40;
+	const size_t CHECKSUM_SIZE = 8;
+
+	void put_u64(unsigned char *dst, uint64_t v)
+	{
+		v = SWAP64LE(v);
+		memcpy(dst, &v, sizeof(v));
+	}
+	uint64_t get_u64(const unsigned char *src)
+	{
+		uint64_t v;
+		memcpy(&v, src, sizeof(v));
+		return SWAP64LE(v);
+	}
+
+	crypto::hash account_hash(const cryptonote::account_keys &account_keys)
+	{
+		static const char domain[] = "subaddress_cache";
+		unsigned char data[sizeof(domain) - 1 + 32 + 32];
+		memcpy(data, domain, sizeof(domain) - 1);
+		memcpy(data + sizeof(domain) - 1, account_keys.m_view_secret_key.data, 32);
+		memcpy(data + sizeof(domain) - 1 + 32, &account_keys.m_account_address.m_spend_public_key, 32);
+
+		crypto::hash hash;
+		crypto::cn_fast_hash(data, sizeof(data), hash);
+		memwipe(data, sizeof(data));
+		return hash;
+	}
+
+	// The first bytes of the hash of the key region
+	void keys_checksum(const unsigned char *keys, uint64_t count, unsigned char *checksum)
+	{
+		crypto::hash hash;
+		crypto::cn_fast_hash(keys, count * KEY_SIZE, hash);
+		memcpy(checksum, &hash, CHECKSUM_SIZE);
+	}
+
+	void fill_header(unsigned char *header, const crypto::hash &hash, const unsigned char *keys, uint64_t count)
+	{
+		memcpy(header, MAGIC, sizeof(MAGIC));
+		memcpy(header + 8, &hash, ACCOUNT_HASH_SIZE);
+		put_u64(header + COUNT_OFFSET, count);
+		keys_checksum(keys, count, header + CHECKSUM_OFFSET);
+	}
+
+	// Number of keys the header vouches for, or 0 if the file is not this account's cache or its keys do not match
+	// the checksum; keys are the file_size - FILE_HEADER_SIZE bytes past the header
+	uint64_t valid_keys_count(const unsigned char *header, size_t file_size, const crypto::hash &hash, const unsigned char *keys)
+	{
+		if (file_size < FILE_HEADER_SIZE || memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || memcmp(header + 8, &hash, ACCOUNT_HASH_SIZE) != 0) {
+			return 0;
+		}
+		const uint64_t count = get_u64(header + COUNT_OFFSET);
+		if (count > (file_size - FILE_HEADER_SIZE) / KEY_SIZE) {
+			return 0; // keys are written before the count, so this is not a torn write
+		}
+		unsigned char checksum[CHECKSUM_SIZE];
+		keys_checksum(keys, count, checksum);
+		return memcmp(checksum, header + CHECKSUM_OFFSET, CHECKSUM_SIZE) == 0 ? count : 0;
+	}
+
+	bool pwrite_all(int fd, const void *data, size_t size, off_t offset)
+	{
+		const char *p = static_cast<const char *>(data);
+		while (size > 0) {
+			const ssize_t n = pwrite(fd, p, size, offset);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			p += n;
+			size -= n;
+			offset += n;
+		}
+		return true;
+	}
+}
+//
+std::string subaddress_cache::file_path(const std::string &cache_path, const cryptonote::account_keys &account_keys)
+{
+	return cache_path + "subaddresses-" + epee::string_tools::pod_to_hex(account_hash(account_keys)) + ".dat";
+}
+size_t subaddress_cache::load(const std::string &file, const cryptonote::account_keys &account_keys, subaddress_table::SubaddressTable &subaddresses)
+{
+	const size_t begin = subaddresses.size();
+
+	const int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return begin;
+	}
+	// shared, so that a concurrent store() does not change the file under the checksum
+	struct stat st;
+	if (flock(fd, LOCK_SH) != 0 || fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) <= FILE_HEADER_SIZE) {
+		::close(fd);
+		return begin;
+	}
+	void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapping == MAP_FAILED) {
+		::close(fd);
+		return begin;
+	}
+
+	const unsigned char *header = static_cast<const unsigned char *>(mapping);
+	const unsigned char *keys = header + FILE_HEADER_SIZE;
+	const uint64_t end = std::min<uint64_t>(valid_keys_count(header, st.st_size, account_hash(account_keys), keys), std::numeric_limits<uint32_t>::max());
+
+	// The checksum only says the keys are as they were written; spot check that they are this account's too
+	const auto matches = [&](uint32_t minor) {
+		const crypto::public_key D = account_keys.get_device().get_subaddress_spend_public_key(account_keys, { 0, minor });
+		return memcmp(&D, keys + minor * KEY_SIZE, KEY_SIZE) == 0;
+	};
+	if (end > begin && matches(begin) && matches(end - 1)) {
+		subaddresses.reserve(end);
+
+		crypto::public_key D;
+		for (uint32_t minor = begin; minor < end; minor++) {
+			memcpy(&D, keys + minor * KEY_SIZE, KEY_SIZE);
+			subaddresses.insert(D, { 0, minor });
+		}
+	}
+
+	munmap(mapping, st.st_size);
+	::close(fd);
+	return subaddresses.size();
+}
+bool subaddress_cache::store(const std::string &file, const cryptonote::account_keys &account_keys, const subaddress_table::SubaddressTable &subaddresses)
+{
+	const int fd = open(file.c_str(), O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		return false;
+	}
+	// held until close; concurrent stores would otherwise race on the ftruncate and the header
+	if (flock(fd, LOCK_EX) != 0) {
+		::close(fd);
+		return false;
+	}
+
+	// The table holds minor indices 0 to size - 1 of major index 0, see expand_subaddresses(). Keys already in a
+	// valid file are kept as they are, since the checksum of the whole region has to be taken from the file.
+	const crypto::hash hash = account_hash(account_keys);
+	const uint64_t end = subaddresses.size();
+	std::string keys;
+	uint64_t begin = 0;
+	unsigned char header[FILE_HEADER_SIZE];
+	struct stat st;
+	if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= FILE_HEADER_SIZE && pread(fd, header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))) {
+		const uint64_t count = std::min<uint64_t>(get_u64(header + COUNT_OFFSET), (st.st_size - FILE_HEADER_SIZE) / KEY_SIZE);
+		keys.resize(count * KEY_SIZE);
+		if (pread(fd, &keys[0], keys.size(), FILE_HEADER_SIZE) == static_cast<ssize_t>(keys.size())) {
+			begin = valid_keys_count(header, FILE_HEADER_SIZE + keys.size(), hash, reinterpret_cast<const unsigned char *>(keys.data()));
+		}
+	}
+	if (begin >= end) {
+		::close(fd);
+		return true;
+	}
+
+	keys.resize(begin * KEY_SIZE);
+	keys.resize(end * KEY_SIZE, '\0');
+	size_t filled = 0;
+	subaddresses.for_each([&](const subaddress_table::SubaddressTable::Entry &entry) {
+		if (entry.index.major == 0 && entry.index.minor >= begin && entry.index.minor < end) {
+			memcpy(&keys[entry.index.minor * KEY_SIZE], &entry.key, KEY_SIZE);
+			filled++;
+		}
+	});
+	if (filled != end - begin) {
+		::close(fd);
+		return false;
+	}
+
+	bool ok = true;
+	if (begin == 0) {
+		// missing, foreign or corrupt: start over with a header vouching for no keys
+		unsigned char empty[FILE_HEADER_SIZE] = {};
+		fill_header(empty, hash, reinterpret_cast<const unsigned char *>(keys.data()), 0);
+		ok = ftruncate(fd, 0) == 0 && pwrite_all(fd, empty, sizeof(empty), 0);
+	}
+
+	fill_header(header, hash, reinterpret_cast<const unsigned char *>(keys.data()), end);
+	ok = ok && pwrite_all(fd, keys.data() + begin * KEY_SIZE, (end - begin) * KEY_SIZE, FILE_HEADER_SIZE + begin * KEY_SIZE)
+		&& pwrite_all(fd, header + COUNT_OFFSET, FILE_HEADER_SIZE - COUNT_OFFSET, COUNT_OFFSET);
+	::close(fd);
+	return ok;
+}
@@ -0,0 +1,46 @@
+//
+//  subaddress_cache.hpp
+//
+//  On-disk cache of an account's subaddress spend public keys, so that a
+//  cold start maps a file instead of redoing a scalar multiplication per
+//  subaddress.
+//
+//  One file per account, named after a hash of its view secret key and
+//  spend public key:
+//    subaddresses-<hash>.dat  header + one 32 byte spend public key per minor
+//                             index of major index 0, in order
+//  The header repeats the first 24 bytes of the hash and holds the number
+//  of keys and a checksum of them. Keys are appended before the header
+//  count and checksum are raised, so a torn write leaves only unreferenced
+//  keys behind. A file whose keys do not match the checksum is rejected on
+//  load and rewritten by the next store; the first and last keys are also
+//  derived again as a check against a foreign file. Stores hold a flock
+//  on the file.
+//
+
+#ifndef subaddress_cache_hpp
+#define subaddress_cache_hpp
+
+#include <string>
+//
+#include "cryptonote_basic/account.h"
+#include "subaddress_table.hpp"
+
+namespace subaddress_cache
+{
+	using namespace std;
+
+	const size_t FILE_HEADER_SIZE = 48; // 8 byte magic, 24 byte account hash, 8 byte key count, 8 byte checksum
+	const size_t KEY_SIZE = 32;
+
+	// cache_path is used as a prefix, like storage_path for pruned blocks
+	std::string file_path(const std::string &cache_path, const cryptonote::account_keys &account_keys);
+
+	// Inserts the cached keys past the ones already in subaddresses. Returns the number of keys in the table
+	// afterwards; anything unreadable or failing validation is ignored.
+	size_t load(const std::string &file, const cryptonote::account_keys &account_keys, subaddress_table::SubaddressTable &subaddresses);
+	// Appends the keys of subaddresses not yet in the file, rewriting it if it is missing or invalid
+	bool store(const std::string &file, const cryptonote::account_keys &account_keys, const subaddress_table::SubaddressTable &subaddresses);
+}
+
+#endif /* subaddress_cache_hpp */
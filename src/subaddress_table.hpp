@@ -0,0 +1,238 @@
+//
+//  subaddress_table.hpp
+//
+//  Flat hash table from subaddress spend public keys to subaddress indices,
+//  in the style of a Swiss table: one control byte per slot holding 7 bits
+//  of the key's hash, probed 16 slots at a time, with the (key, index)
+//  entries in a single contiguous array. Lookups touch one control group and,
+//  almost always, a single entry; memory is 41 bytes per slot with slots
+//  kept at most 7/8 full.
+//
+//  Subaddress tables only ever grow, so there is no erase and no tombstones.
+//
+
+#ifndef subaddress_table_hpp
+#define subaddress_table_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <boost/optional.hpp>
+//
+#include "crypto/crypto.h"
+#include "cryptonote_basic/subaddress_index.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "device/device.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace subaddress_table
+{
+	using namespace std;
+
+	class SubaddressTable
+	{
+	public:
+		struct Entry
+		{
+			crypto::public_key key;
+			cryptonote::subaddress_index index;
+		};
+
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+		size_t capacity() const { return m_entries.size(); }
+		size_t memory_usage() const { return m_ctrl.size() + m_entries.size() * sizeof(Entry); }
+
+		void reserve(size_t count)
+		{
+			size_t capacity = GROUP_SIZE;
+			while (capacity * max_load_num < count * max_load_den) {
+				capacity *= 2;
+			}
+			if (capacity > m_entries.size()) {
+				rehash(capacity);
+			}
+		}
+
+		// Overwrites the index of a key already present
+		void insert(const crypto::public_key &key, const cryptonote::subaddress_index &index)
+		{
+			const uint64_t h = hash_of(key);
+			if (Entry *entry = find_entry(key, h)) {
+				entry->index = index;
+				return;
+			}
+
+			if ((m_size + 1) * max_load_den > m_entries.size() * max_load_num) {
+				rehash(m_entries.empty() ? GROUP_SIZE : m_entries.size() * 2);
+			}
+			insert_new(key, index, h);
+		}
+
+		const cryptonote::subaddress_index *find(const crypto::public_key &key) const
+		{
+			const Entry *entry = const_cast<SubaddressTable *>(this)->find_entry(key, hash_of(key));
+			return entry ? &entry->index : nullptr;
+		}
+
+		// Calls fn(entry) for every entry, in no particular order
+		template<typename F>
+		void for_each(F fn) const
+		{
+			for (size_t i = 0; i < m_entries.size(); i++) {
+				if (m_ctrl[i] != CTRL_EMPTY) {
+					fn(m_entries[i]);
+				}
+			}
+		}
+
+	private:
+		static const size_t GROUP_SIZE = 16;
+		static const int8_t CTRL_EMPTY = -128; // full slots hold 7 hash bits, 0 to 127
+		static const size_t max_load_num = 7;
+		static const size_t max_load_den = 8;
+
+		// Spend public keys are curve points, so their leading bytes are already uniformly distributed
+		static uint64_t hash_of(const crypto::public_key &key)
+		{
+			uint64_t h;
+			memcpy(&h, &key, sizeof(h));
+			return h;
+		}
+		static int8_t h2_of(uint64_t h) { return static_cast<int8_t>(h >> 57); }
+		size_t h1_of(uint64_t h) const { return static_cast<size_t>(h) & mask(); }
+		size_t mask() const { return m_entries.size() - 1; }
+
+		// Bit i is set if control byte pos + i equals ctrl
+		uint32_t match(size_t pos, int8_t ctrl) const
+		{
+#if defined(__SSE2__)
+			const __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&m_ctrl[pos]));
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(ctrl))));
+#else
+			// Eight slots per word: flag the zero bytes of word ^ ctrl, then gather the flags into the low byte. A
+			// byte can be flagged spuriously only above a real match, which probing tolerates either way.
+			const uint64_t lsbs = 0x0101010101010101ull;
+			uint32_t bits = 0;
+			for (size_t half = 0; half < 2; half++) {
+				uint64_t word;
+				memcpy(&word, &m_ctrl[pos + half * 8], sizeof(word));
+				const uint64_t x = word ^ (lsbs * static_cast<uint8_t>(ctrl));
+				const uint64_t zeros = ((x - lsbs) & ~x & (lsbs << 7)) >> 7;
+				bits |= static_cast<uint32_t>((zeros * 0x0102040810204080ull) >> 56) << (half * 8);
+			}
+			return bits;
+#endif
+		}
+		static unsigned lowest_bit(uint32_t bits)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			return static_cast<unsigned>(__builtin_ctz(bits));
+#else
+			unsigned i = 0;
+			while (!(bits & 1)) {
+				bits >>= 1;
+				i++;
+			}
+			return i;
+#endif
+		}
+
+		// Groups are probed at triangular offsets, which visits every group once the capacity is a power of two
+		Entry *find_entry(const crypto::public_key &key, uint64_t h)
+		{
+			if (m_size == 0) {
+				return nullptr;
+			}
+			const int8_t h2 = h2_of(h);
+			size_t pos = h1_of(h);
+			for (size_t stride = GROUP_SIZE;; stride += GROUP_SIZE) {
+				for (uint32_t bits = match(pos, h2); bits != 0; bits &= bits - 1) {
+					Entry &entry = m_entries[(pos + lowest_bit(bits)) & mask()];
+					if (entry.key == key) {
+						return &entry;
+					}
+				}
+				if (match(pos, CTRL_EMPTY) != 0) {
+					return nullptr;
+				}
+				pos = (pos + stride) & mask();
+			}
+		}
+
+		void insert_new(const crypto::public_key &key, const cryptonote::subaddress_index &index, uint64_t h)
+		{
+			size_t pos = h1_of(h);
+			for (size_t stride = GROUP_SIZE;; stride += GROUP_SIZE) {
+				const uint32_t empty = match(pos, CTRL_EMPTY);
+				if (empty != 0) {
+					const size_t i = (pos + lowest_bit(empty)) & mask();
+					set_ctrl(i, h2_of(h));
+					m_entries[i].key = key;
+					m_entries[i].index = index;
+					m_size++;
+					return;
+				}
+				pos = (pos + stride) & mask();
+			}
+		}
+
+		// The first GROUP_SIZE - 1 control bytes are mirrored past the end, so a group can be loaded from any slot
+		void set_ctrl(size_t i, int8_t ctrl)
+		{
+			m_ctrl[i] = ctrl;
+			if (i < GROUP_SIZE - 1) {
+				m_ctrl[m_entries.size() + i] = ctrl;
+			}
+		}
+
+		void rehash(size_t capacity)
+		{
+			std::vector<int8_t> ctrl(capacity + GROUP_SIZE - 1, int8_t(CTRL_EMPTY));
+			std::vector<Entry> entries(capacity);
+			ctrl.swap(m_ctrl);
+			entries.swap(m_entries);
+
+			m_size = 0;
+			for (size_t i = 0; i < entries.size(); i++) {
+				if (ctrl[i] != CTRL_EMPTY) {
+					insert_new(entries[i].key, entries[i].index, hash_of(entries[i].key));
+				}
+			}
+		}
+
+		std::vector<int8_t> m_ctrl; // capacity + GROUP_SIZE - 1
+		std::vector<Entry> m_entries; // capacity, a power of two
+		size_t m_size = 0;
+	};
+
+	// Same as cryptonote::is_out_to_acc_precomp, looking the derived spend key up in a SubaddressTable
+	inline boost::optional<cryptonote::subaddress_receive_info> is_out_to_acc_precomp(const SubaddressTable &subaddresses, const crypto::public_key &out_key, const crypto::key_derivation &derivation, const std::vector<crypto::key_derivation> &additional_derivations, size_t output_index, hw::device &hwdev, const boost::optional<crypto::view_tag> &view_tag_opt = boost::none)
+	{
+		crypto::public_key subaddress_spendkey;
+		if (cryptonote::out_can_be_to_acc(view_tag_opt, derivation, output_index, &hwdev)) {
+			if (!hwdev.derive_subaddress_public_key(out_key, derivation, output_index, subaddress_spendkey)) {
+				return boost::none;
+			}
+			if (const cryptonote::subaddress_index *index = subaddresses.find(subaddress_spendkey)) {
+				return cryptonote::subaddress_receive_info{ *index, derivation };
+			}
+		}
+
+		if (output_index < additional_derivations.size() && cryptonote::out_can_be_to_acc(view_tag_opt, additional_derivations[output_index], output_index, &hwdev)) {
+			if (!hwdev.derive_subaddress_public_key(out_key, additional_derivations[output_index], output_index, subaddress_spendkey)) {
+				return boost::none;
+			}
+			if (const cryptonote::subaddress_index *index = subaddresses.find(subaddress_spendkey)) {
+				return cryptonote::subaddress_receive_info{ *index, additional_derivations[output_index] };
+			}
+		}
+
+		return boost::none;
+	}
+}
+
+#endif /* subaddress_table_hpp */
@@ -0,0 +1,259 @@
+//
+//  tx_scan_reader.cpp
+//
+#include "tx_scan_reader.hpp"
+//
+#include "cryptonote_basic/tx_extra.h"
+
+using namespace std;
+//
+using namespace tx_scan_reader;
+
+namespace {
+	// Variant tags of the binary archive, from cryptonote_basic.h
+	const uint8_t TXIN_GEN = 0xff;
+	const uint8_t TXIN_TO_KEY = 0x2;
+	const uint8_t TXOUT_TO_KEY = 0x2;
+	const uint8_t TXOUT_TO_TAGGED_KEY = 0x3;
+
+	struct Cursor
+	{
+		const char *pos;
+		const char *end;
+
+		size_t left() const { return end - pos; }
+
+		bool skip(size_t n)
+		{
+			if (left() < n) return false;
+			pos += n;
+			return true;
+		}
+		// Returns a pointer to the next n bytes and moves past them, or null if there are fewer left
+		const char *take(size_t n)
+		{
+			const char *p = pos;
+			return skip(n) ? p : nullptr;
+		}
+		bool read_byte(uint8_t &b)
+		{
+			if (pos == end) return false;
+			b = static_cast<uint8_t>(*pos++);
+			return true;
+		}
+		bool read_varint(uint64_t &v)
+		{ // 7 bits per byte, low group first, high bit set on all but the last
+			v = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7) {
+				uint8_t b;
+				if (!read_byte(b)) return false;
+				v |= static_cast<uint64_t>(b & 0x7f) << shift;
+				if (!(b & 0x80)) return true;
+			}
+			return false;
+		}
+		bool read_count(size_t &count, size_t min_item_size)
+		{ // checked against what is left, so a corrupt count cannot make the caller reserve gigabytes
+			uint64_t v;
+			if (!read_varint(v) || v > left() / min_item_size) return false;
+			count = v;
+			return true;
+		}
+		bool skip_string()
+		{
+			size_t size;
+			return read_count(size, 1) && skip(size);
+		}
+	};
+
+	bool read_inputs(Cursor &c, TxView &tx, uint64_t &inputs_amount, size_t &inputs_count)
+	{
+		if (!c.read_count(inputs_count, 1)) return false;
+
+		for (size_t i = 0; i < inputs_count; i++) {
+			uint8_t tag;
+			if (!c.read_byte(tag)) return false;
+
+			uint64_t v;
+			if (tag == TXIN_GEN) {
+				if (!c.read_varint(v)) return false; // height
+			} else if (tag == TXIN_TO_KEY) {
+				if (!c.read_varint(v)) return false;
+				inputs_amount += v;
+
+				size_t offsets_count;
+				if (!c.read_count(offsets_count, 1)) return false;
+				for (size_t k = 0; k < offsets_count; k++) {
+					if (!c.read_varint(v)) return false;
+				}
+
+				const char *key_image = c.take(sizeof(crypto::key_image));
+				if (!key_image) return false;
+				tx.key_images.push_back(reinterpret_cast<const crypto::key_image *>(key_image));
+			} else {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool read_outputs(Cursor &c, TxView &tx, uint64_t &outputs_amount)
+	{
+		size_t count;
+		if (!c.read_count(count, 1 + 1 + sizeof(crypto::public_key))) return false;
+
+		tx.outputs.resize(count);
+		for (auto &output : tx.outputs) {
+			uint8_t tag;
+			if (!c.read_varint(output.amount) || !c.read_byte(tag)) return false;
+			outputs_amount += output.amount;
+
+			if (tag != TXOUT_TO_KEY && tag != TXOUT_TO_TAGGED_KEY) return false;
+			const char *key = c.take(sizeof(crypto::public_key));
+			if (!key) return false;
+			output.key = reinterpret_cast<const crypto::public_key *>(key);
+
+			output.view_tag = boost::none;
+			if (tag == TXOUT_TO_TAGGED_KEY) {
+				uint8_t b;
+				if (!c.read_byte(b)) return false;
+				crypto::view_tag view_tag;
+				view_tag.data = static_cast<char>(b);
+				output.view_tag = view_tag;
+			}
+		}
+		return true;
+	}
+
+	// rct::rctSigBase::serialize_rctsig_base() for the given numbers of inputs and outputs
+	bool read_rct_base(Cursor &c, TxView &tx, size_t inputs_count)
+	{
+		if (!c.read_byte(tx.rct_type)) return false;
+
+		switch (tx.rct_type) {
+			case rct::RCTTypeNull:
+				return true;
+			case rct::RCTTypeFull:
+			case rct::RCTTypeSimple:
+			case rct::RCTTypeBulletproof:
+				tx.ecdh_info_size = 2 * sizeof(rct::key);
+				break;
+			case rct::RCTTypeBulletproof2:
+			case rct::RCTTypeCLSAG:
+			case rct::RCTTypeBulletproofPlus:
+				tx.ecdh_info_size = 8;
+				break;
+			default:
+				return false;
+		}
+
+		if (!c.read_varint(tx.fee)) return false;
+		if (tx.rct_type == rct::RCTTypeSimple) { // pseudoOuts, moved to the prunable part from Bulletproof on
+			if (inputs_count > c.left() / sizeof(rct::key) || !c.skip(inputs_count * sizeof(rct::key))) return false;
+		}
+
+		const size_t outputs_count = tx.outputs.size();
+		const char *ecdh_info = c.take(outputs_count * tx.ecdh_info_size);
+		const char *out_pk_masks = c.take(outputs_count * sizeof(rct::key));
+		if (!ecdh_info || !out_pk_masks) return false;
+		tx.ecdh_info = reinterpret_cast<const unsigned char *>(ecdh_info);
+		tx.out_pk_masks = reinterpret_cast<const rct::key *>(out_pk_masks);
+		return true;
+	}
+}
+//
+bool tx_scan_reader::read(const cryptonote::blobdata_ref &blob, TxView &tx)
+{
+	Cursor c{blob.data(), blob.data() + blob.size()};
+
+	tx.key_images.clear();
+	tx.outputs.clear();
+	tx.extra = cryptonote::blobdata_ref();
+	tx.rct_type = rct::RCTTypeNull;
+	tx.fee = 0;
+	tx.ecdh_info = nullptr;
+	tx.ecdh_info_size = 0;
+	tx.out_pk_masks = nullptr;
+
+	uint64_t version;
+	if (!c.read_varint(version) || version == 0 || version > 2 || !c.read_varint(tx.unlock_time)) return false;
+	tx.version = version;
+
+	uint64_t inputs_amount = 0, outputs_amount = 0;
+	size_t inputs_count;
+	if (!read_inputs(c, tx, inputs_amount, inputs_count) || !read_outputs(c, tx, outputs_amount)) return false;
+
+	size_t extra_size;
+	if (!c.read_count(extra_size, 1)) return false;
+	tx.extra = cryptonote::blobdata_ref(c.take(extra_size), extra_size);
+
+	if (tx.version == 1) {
+		// the ring signatures that follow are not needed
+		tx.fee = inputs_amount - outputs_amount;
+		return true;
+	}
+	return read_rct_base(c, tx, inputs_count);
+}
+
+bool tx_scan_reader::read_extra(const cryptonote::blobdata_ref &extra, ExtraView &fields)
+{
+	Cursor c{extra.data(), extra.data() + extra.size()};
+	fields = ExtraView();
+	bool has_nonce = false;
+
+	while (c.left() != 0) {
+		uint8_t tag;
+		c.read_byte(tag);
+
+		switch (tag) {
+			case TX_EXTRA_TAG_PADDING: {
+				// zeros up to the end, tag included at most TX_EXTRA_PADDING_MAX_COUNT bytes
+				if (c.left() + 1 > TX_EXTRA_PADDING_MAX_COUNT) return false;
+				for (; c.pos != c.end; c.pos++) {
+					if (*c.pos != 0) return false;
+				}
+				break;
+			}
+			case TX_EXTRA_TAG_PUBKEY: {
+				const char *pub = c.take(sizeof(crypto::public_key));
+				if (!pub) return false;
+				if (!fields.pub) {
+					fields.pub = reinterpret_cast<const crypto::public_key *>(pub);
+				}
+				break;
+			}
+			case TX_EXTRA_NONCE: {
+				size_t size;
+				if (!c.read_count(size, 1) || size > TX_EXTRA_NONCE_MAX_COUNT) return false;
+				const char *nonce = c.take(size);
+				if (has_nonce) break;
+				has_nonce = true;
+				// what get_encrypted_payment_id_from_tx_extra_nonce() and get_payment_id_from_tx_extra_nonce() accept
+				if (size == 1 + sizeof(crypto::hash8) && static_cast<uint8_t>(nonce[0]) == TX_EXTRA_NONCE_ENCRYPTED_PAYMENT_ID) {
+					fields.payment_id8 = reinterpret_cast<const crypto::hash8 *>(nonce + 1);
+				} else if (size == 1 + sizeof(crypto::hash) && static_cast<uint8_t>(nonce[0]) == TX_EXTRA_NONCE_PAYMENT_ID) {
+					fields.payment_id = reinterpret_cast<const crypto::hash *>(nonce + 1);
+				}
+				break;
+			}
+			case TX_EXTRA_MERGE_MINING_TAG:
+			case TX_EXTRA_MYSTERIOUS_MINERGATE_TAG: {
+				if (!c.skip_string()) return false;
+				break;
+			}
+			case TX_EXTRA_TAG_ADDITIONAL_PUBKEYS: {
+				size_t count;
+				if (!c.read_count(count, sizeof(crypto::public_key))) return false;
+				const char *pubs = c.take(count * sizeof(crypto::public_key));
+				if (!fields.additional_pubs) {
+					fields.additional_pubs = reinterpret_cast<const crypto::public_key *>(pubs);
+					fields.additional_pubs_count = count;
+				}
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+	return true;
+}
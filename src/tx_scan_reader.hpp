@@ -0,0 +1,68 @@
+//
+//  tx_scan_reader.hpp
+//
+//  Single pass decoder for the parts of a tx blob that scanning needs: input
+//  key images, output keys and view tags, extra, and from the rct signatures
+//  base the fee, ecdhInfo and outPk masks. Everything is handed out as views
+//  into the blob; nothing past the layout is validated, no variants are
+//  constructed and the prunable part, if the blob has one, is never read.
+//  The tx extra fields are read the same way.
+//
+
+#ifndef tx_scan_reader_hpp
+#define tx_scan_reader_hpp
+
+#include <vector>
+#include <boost/optional.hpp>
+#include "cryptonote_basic/blobdatatype.h"
+#include "crypto/crypto.h"
+#include "ringct/rctTypes.h"
+
+namespace tx_scan_reader
+{
+	using namespace std;
+
+	struct OutputView
+	{
+		uint64_t amount; // 0 for RingCT outputs
+		const crypto::public_key *key;
+		boost::optional<crypto::view_tag> view_tag;
+	};
+
+	// Views into the blob, so only valid while it is
+	struct TxView
+	{
+		size_t version = 0;
+		uint64_t unlock_time = 0;
+		std::vector<const crypto::key_image *> key_images; // of the txin_to_key inputs
+		std::vector<OutputView> outputs;
+		cryptonote::blobdata_ref extra;
+		uint8_t rct_type = rct::RCTTypeNull;
+		uint64_t fee = 0; // txnFee, or for v1 the inputs less the outputs, the way serial_bridge::get_fee() has it
+		const unsigned char *ecdh_info = nullptr; // outputs.size() entries of ecdh_info_size bytes; null without RingCT amounts
+		size_t ecdh_info_size = 0; // 8 for the amount only types, otherwise 32 mask + 32 amount
+		const rct::key *out_pk_masks = nullptr; // outputs.size() commitments; null without RingCT amounts
+	};
+
+	// The fields of tx extra that scanning reads, each from the first field of its kind like the find_tx_extra_field_by_type()
+	// lookups have it; views into the extra, so only valid while it is
+	struct ExtraView
+	{
+		const crypto::public_key *pub = nullptr;
+		const crypto::public_key *additional_pubs = nullptr;
+		size_t additional_pubs_count = 0;
+		const crypto::hash8 *payment_id8 = nullptr; // if the nonce holds an encrypted payment id
+		const crypto::hash *payment_id = nullptr; // if the nonce holds a long one
+	};
+
+	// Reuses the vectors of the passed view. Takes pruned and full blobs alike; returns false on a truncated blob,
+	// an unsupported version or rct type, or script inputs and outputs, which parse_and_validate_tx_from_blob()
+	// would not get past either.
+	bool read(const cryptonote::blobdata_ref &blob, TxView &tx);
+
+	// Walks the extra fields in place instead of building a vector of variants; returns false where
+	// cryptonote::parse_tx_extra() would
+	bool read_extra(const cryptonote::blobdata_ref &extra, ExtraView &fields);
+}
+
+#endif /* tx_scan_reader_hpp */